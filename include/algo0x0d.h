@@ -64,14 +64,43 @@ class Algo0x0D : public Algorithm
                     unsigned long       currentVerticalPenPosition,
                     const unsigned long wrapWidth );
 
+        inline uint64_t loadPixelsWord(
+                    const unsigned char * data,
+                    unsigned long       byteIndex,
+                    unsigned long       rowBytes );
+
+        inline unsigned long findPixel(
+                    const unsigned char * data,
+                    unsigned long       pixelIndex,
+                    unsigned long       workWidth,
+                    unsigned long       rowBytes,
+                    bool                black );
+
     public:
         Algo0x0D();
         virtual ~Algo0x0D();
 
+    public:
+        /**
+          * Tell if the encoding of a band will surely be given up.
+          * Each run of black pixels takes at least a two-byte packet, so the
+          * band is unsuited to this algorithm if a scan-line has too many
+          * runs. The runs are counted a word at a time without encoding
+          * anything.
+          * @param data the band bitmap
+          * @param width the band width
+          * @param height the band height
+          * @return TRUE if @ref compress would not create a plane. Otherwise
+          *         it returns FALSE, which does not mean that the band can be
+          *         encoded.
+          */
+        bool                    mustGiveUp(const unsigned char *data, 
+                                    unsigned long width, unsigned long height);
+
     public:
         virtual BandPlane*      compress(const Request& request, 
                                     unsigned char *data, unsigned long width,
-                                    unsigned long height);
+                                    unsigned long height, Arena& arena);
         virtual bool            reverseLineColumn() {return false;}
         virtual bool            inverseByte() {return false;}
         virtual bool            splitIntoBands() {return true;}
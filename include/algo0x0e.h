@@ -62,7 +62,7 @@ class Algo0x0E : public Algorithm
     public:
         virtual BandPlane*      compress(const Request& request, 
                                     unsigned char *data, unsigned long width,
-                                    unsigned long height);
+                                    unsigned long height, Arena& arena);
         virtual bool            reverseLineColumn() {return false;}
         virtual bool            inverseByte() {return true;}
         virtual bool            splitIntoBands() {return true;}
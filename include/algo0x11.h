@@ -32,6 +32,10 @@
 
 #define COMPRESSION_FLAG        0x80
 
+#define MATCH_HASH_BITS         12
+#define MATCH_HASH_SIZE         (1 << MATCH_HASH_BITS)
+#define MATCH_CHAIN_SIZE        (2 * COMPRESS_SAMPLE_RATE)
+
 /**
   * @brief This class implements the compression algorithm 0x11.
   */
@@ -40,14 +44,36 @@ class Algo0x11 : public Algorithm
     protected:
         uint32_t                _ptrArray[TABLE_PTR_SIZE];
 
+        /*
+         * The match finder indexes the previous positions with a hash of
+         * their next three bytes. Only the last COMPRESS_SAMPLE_RATE
+         * positions are counted since no pointer goes further.
+         */
+        long                    _ptrIndex[COMPRESS_SAMPLE_RATE + 1];
+        long                    _hashHeads[MATCH_HASH_SIZE];
+        long                    _hashChain[MATCH_CHAIN_SIZE];
+        unsigned short          _hashCounts[MATCH_HASH_SIZE];
+        unsigned long           _indexedNr;
+
     protected:
         static int              __compare(const void *n1, const void *n2);
+        static inline uint32_t  __prefix(const unsigned char *data);
+        static inline unsigned long __hash(uint32_t prefix);
+        static inline unsigned long __matchLength(const unsigned char *data,
+                                    const unsigned char *previous,
+                                    unsigned long max);
+        void                    _indexPositions(const unsigned char *data,
+                                    unsigned long r);
+        unsigned long           _findBestPiece(const unsigned char *data,
+                                    unsigned long r, unsigned long maxCompSize,
+                                    unsigned long &bestPtr);
         bool                    _lookupBestOccurs(const unsigned char* data,
                                     unsigned long size);
         bool                    _compress(const unsigned char *data, 
                                     unsigned long size, 
                                     unsigned char* &output, 
-                                    unsigned long &outputSize);
+                                    unsigned long &outputSize,
+                                    unsigned long &checksum, Arena& arena);
 
     public:
         Algo0x11();
@@ -56,7 +82,7 @@ class Algo0x11 : public Algorithm
     public:
         virtual BandPlane*      compress(const Request& request, 
                                     unsigned char *data, unsigned long width,
-                                    unsigned long height);
+                                    unsigned long height, Arena& arena);
         virtual bool            reverseLineColumn() {return true;}
         virtual bool            inverseByte() {return true;}
         virtual bool            splitIntoBands() {return true;}
@@ -44,7 +44,10 @@ class Algo0x13 : public Algorithm
             bandList_t*         last;
             unsigned char*      data;
             unsigned long       size;
+            unsigned long       checksum;
             unsigned long       maxSize;
+            Arena*              arena;
+            bool                error;
         } info_t;
 
     protected:
@@ -59,10 +62,38 @@ class Algo0x13 : public Algorithm
     public:
         static void             _callback(unsigned char *data, size_t len, void *arg);
 
+    public:
+        /**
+          * Encode a whole bitmap into a JBIG stream split into band planes.
+          * The lines are read in place so the bitmap can be a part of a
+          * bigger one. Instances encoding different bitmaps can run at the
+          * same time.
+          * @param request the request instance
+          * @param data the first line of the bitmap
+          * @param lineWidthInB the distance in bytes between two lines
+          * @param width the bitmap width
+          * @param linesNr the number of lines to read. The next lines up to
+          *        the bitmap height are blank
+          * @param height the bitmap height
+          * @param arena the arena in which the band planes are allocated
+          * @return TRUE if the bitmap has been encoded. Otherwise it returns
+          *         FALSE.
+          */
+        bool                    encode(const Request& request, 
+                                    const unsigned char *data, 
+                                    unsigned long lineWidthInB,
+                                    unsigned long width, unsigned long linesNr,
+                                    unsigned long height, Arena& arena);
+        /**
+          * Get the next band plane of the encoded stream.
+          * @return the band plane or NULL if there is no more band plane.
+          */
+        BandPlane*              nextPlane();
+
     public:
         virtual BandPlane*      compress(const Request& request, 
                                     unsigned char *data, unsigned long width,
-                                    unsigned long height);
+                                    unsigned long height, Arena& arena);
 };
 
 #endif /* DISABLE_JBIG */
@@ -34,11 +34,19 @@
 class Algo0x15 : public Algorithm
 {
     protected:
-        bool                    _error;
-        bool                    _has_bih;
+        /* Output context of an encoding. */
+        typedef struct output_s {
+            bool                error;
+            bool                hasBIH;
+            unsigned char*      bih;
+            unsigned char*      data;
+            unsigned long       size;
+            unsigned long       checksum;
+            unsigned long       maxSize;
+        } output_t;
+
+    protected:
         unsigned char           _bih[20];
-        unsigned char*          _data;
-        unsigned long           _size;
         unsigned long           _maxSize;
 
     public:
@@ -48,10 +56,32 @@ class Algo0x15 : public Algorithm
     public:
         static void             _callback(unsigned char *data, size_t len, void *arg);
 
+    public:
+        /**
+          * Load the maximum size of an encoded band.
+          * It has to be called before @ref encode.
+          * @param request the request instance
+          */
+        void                    loadPacketSize(const Request& request);
+        /**
+          * Encode a band.
+          * Each call has its own output context, so bands can be encoded by
+          * several threads at the same time with the same instance.
+          * @param data the band bitmap
+          * @param width the band width
+          * @param height the band height
+          * @param arena the arena in which the band plane is allocated
+          * @param bih the buffer which receives the 20 bytes of the BIH
+          * @return the band plane or NULL if an error occurred.
+          */
+        BandPlane*              encode(const unsigned char *data, 
+                                    unsigned long width, unsigned long height,
+                                    Arena& arena, unsigned char *bih) const;
+
     public:
         virtual BandPlane*      compress(const Request& request, 
                                     unsigned char *data, unsigned long width,
-                                    unsigned long height);
+                                    unsigned long height, Arena& arena);
         /* Returns BIH for the compressed image band,
            after compress has been called. */
         const unsigned char*    getBIHdata() const { return _bih; } 
@@ -21,6 +21,7 @@
 #ifndef _ALGORITHM_H_
 #define _ALGORITHM_H_
 
+class Arena;
 class Request;
 class BandPlane;
 
@@ -49,11 +50,12 @@ class Algorithm
           * @param data the data to compress
           * @param width the width of the data / band / page
           * @param height the height of the data / band / page
+          * @param arena the arena of the page where to allocate the band plane
           * @return a pointer to a @ref BandPlane instance or NULL.
           */
         virtual BandPlane*      compress(const Request& request, 
                                     unsigned char *data, unsigned long width,
-                                    unsigned long height) = 0;
+                                    unsigned long height, Arena& arena) = 0;
         /**
           * Reverse line and column.
           * the byte at (x=1, y=0) is placed at (x=0, y=1) etc.
@@ -0,0 +1,120 @@
+/*
+ * 	    arena.h                   (C) 2008, Aurélien Croc (AP²C)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the
+ *  Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ *  $Id$
+ * 
+ */
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include "semaphore.h"
+
+/**
+  * @brief This class allocates the memory of the compressed representation of
+  *        a page.
+  *
+  * The memory is taken in large chunks and is never freed piece by piece. All
+  * the chunks are released at once with the arena. Allocations can be done by
+  * several threads at the same time.
+  *
+  * An encoder which only knows the worst case size of its output can reserve
+  * a block of this size, encode directly into it and then trim it to the
+  * size really used. The unused end of the block is given back without
+  * copying the data.
+  */
+class Arena
+{
+    protected:
+        typedef struct chunk_s {
+            unsigned char*      data;
+            unsigned long       used;
+            unsigned long       size;
+            struct chunk_s*     next;
+        } chunk_t;
+
+    protected:
+        chunk_t*                _current;
+        chunk_t*                _large;
+        chunk_t*                _reserved;
+        unsigned long           _size;
+#ifndef DISABLE_THREADS
+        Semaphore               _lock;
+#endif /* DISABLE_THREADS */
+
+    protected:
+        static chunk_t*         _newChunk(unsigned long size);
+        static void             _freeChunks(chunk_t* chunk);
+
+    public:
+        /**
+          * Initialize the instance.
+          */
+        Arena();
+        /**
+          * Destroy the instance and release all the allocated memory.
+          */
+        virtual ~Arena();
+
+    public:
+        /**
+          * Allocate memory in the arena.
+          * The memory is suitably aligned for any object.
+          * @param size the size to allocate
+          * @return the allocated memory.
+          */
+        void*                   allocate(unsigned long size);
+        /**
+          * Copy data into the arena.
+          * @param data the data to copy
+          * @param size the size of the data
+          * @return the copy of the data.
+          */
+        unsigned char*          duplicate(const unsigned char* data, 
+                                    unsigned long size);
+        /**
+          * Reserve a block of memory to encode data of unknown size.
+          * The block does not belong to the arena until it has been trimmed.
+          * It must be given to trim() or release() once the encoding is done.
+          * @param maxSize the maximum size of the data
+          * @return the reserved block.
+          */
+        unsigned char*          reserve(unsigned long maxSize);
+        /**
+          * Give back the unused end of a reserved block and keep the rest in
+          * the arena.
+          * The data are kept in place whenever possible. The returned address
+          * must be used since the block could have been moved.
+          * @param data the reserved block
+          * @param size the size really used
+          * @return the address of the data in the arena.
+          */
+        unsigned char*          trim(unsigned char* data, unsigned long size);
+        /**
+          * Release a reserved block which is not used anymore.
+          * @param data the reserved block
+          */
+        void                    release(unsigned char* data);
+        /**
+          * @return the memory reserved by the arena in bytes.
+          */
+        unsigned long           size() const {return _size;}
+};
+
+#endif /* _ARENA_H_ */
+
+/* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
+
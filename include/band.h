@@ -24,11 +24,16 @@
 #include <stddef.h>
 
 class Page;
+class Arena;
 class BandPlane;
+class SpillReader;
+class SpillWriter;
 
 /**
   * @brief This class contains all information related to a band.
   *
+  * Instances are allocated in the @ref Arena of the page and are released
+  * with it.
   */
 class Band
 {
@@ -53,10 +58,18 @@ class Band
           * @param height the band height
           */
         Band (unsigned long nr, unsigned long width, unsigned long height);
+
+    public:
+        /**
+          * Allocate an instance in an arena.
+          * @param size the size of the instance
+          * @param arena the arena of the page
+          */
+        void*                   operator new(size_t size, Arena& arena);
         /**
-          * Destroy the instance
+          * Nothing to free: the memory is released with the arena.
           */
-        virtual ~Band();
+        void                    operator delete(void* ptr, Arena& arena) {}
 
     public:
         /**
@@ -131,19 +144,21 @@ class Band
 
     public:
         /**
-          * Swap this instance on the disk.
-          * @param fd the file descriptor where the instance has to be swapped
+          * Serialize this instance to swap it on the disk.
+          * @param writer the writer which gathers the serialized instance
           * @return TRUE if the instance has been successfully swapped. 
           *         Otherwise it returns FALSE.
           */
-        bool                    swapToDisk(int fd);
+        bool                    swapToDisk(SpillWriter& writer);
         /**
           * Restore an instance from the disk into memory.
-          * @param fd the file descriptor where the instance has been swapped
+          * @param reader the reader of the serialized instance
+          * @param arena the arena of the page
           * @return a band instance if it has been successfully restored. 
           *         Otherwise it returns NULL.
           */
-        static Band*            restoreIntoMemory(int fd);
+        static Band*            restoreIntoMemory(SpillReader& reader,
+                                    Arena& arena);
 };
 
 #endif /* _BAND_H_ */
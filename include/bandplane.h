@@ -21,9 +21,17 @@
 #ifndef _BANDPLANE_H_
 #define _BANDPLANE_H_
 
+#include <stddef.h>
+
+class Arena;
+class SpillReader;
+class SpillWriter;
+
 /**
   * @brief This class contains data related to a band plane.
   *
+  * Instances and their data are allocated in the @ref Arena of the page and
+  * are released with it.
   */
 class BandPlane
 {
@@ -40,7 +48,7 @@ class BandPlane
     protected:
         unsigned char           _colorNr;
         unsigned long           _size;
-        unsigned char*          _data;
+        const unsigned char*    _data;
         unsigned long           _checksum;
         Endian                  _endian;
         unsigned char           _compression;
@@ -50,10 +58,18 @@ class BandPlane
           * Initialize the band plane instance.
           */
         BandPlane();
+
+    public:
         /**
-          * Destroy the instance
+          * Allocate an instance in an arena.
+          * @param size the size of the instance
+          * @param arena the arena of the page
           */
-        virtual ~BandPlane();
+        void*                   operator new(size_t size, Arena& arena);
+        /**
+          * Nothing to free: the memory is released with the arena.
+          */
+        void                    operator delete(void* ptr, Arena& arena) {}
 
     public:
         /**
@@ -63,12 +79,21 @@ class BandPlane
         void                    setColorNr(unsigned char nr) {_colorNr = nr;}
         /**
           * Set the data buffer.
-          * The buffer will be freed during the destruction of this instance.
+          * The buffer has to be allocated in the arena of the page.
           * @param data the data buffer
           * @param size the size of the data
           */
-        void                    setData(unsigned char *data, 
+        void                    setData(const unsigned char *data, 
                                     unsigned long size);
+        /**
+          * Set the data buffer and its checksum computed by the encoder.
+          * The buffer has to be allocated in the arena of the page.
+          * @param data the data buffer
+          * @param size the size of the data
+          * @param checksum the sum of all the bytes of the data
+          */
+        void                    setData(const unsigned char *data, 
+                                    unsigned long size, unsigned long checksum);
         /**
           * Set the endian to use.
           * @param endian the endian to use.
@@ -108,19 +133,35 @@ class BandPlane
 
     public:
         /**
-          * Swap this instance on the disk.
-          * @param fd the file descriptor where the instance has to be swapped
+          * Compute the checksum of a buffer.
+          * It is the sum of all its bytes. Encoders which can't keep it while
+          * writing their output use it on each piece of output they produce.
+          * @param data the buffer
+          * @param size the size of the buffer
+          * @return the checksum.
+          */
+        static unsigned long    computeChecksum(const unsigned char *data,
+                                    unsigned long size);
+
+    public:
+        /**
+          * Serialize this instance to swap it on the disk.
+          * @param writer the writer which gathers the serialized instance
           * @return TRUE if the instance has been successfully swapped. 
           *         Otherwise it returns FALSE.
           */
-        bool                    swapToDisk(int fd);
+        bool                    swapToDisk(SpillWriter& writer);
         /**
           * Restore an instance from the disk into memory.
-          * @param fd the file descriptor where the instance has been swapped
+          * The data are not copied: the serialized instance has to be
+          * stored in the arena.
+          * @param reader the reader of the serialized instance
+          * @param arena the arena of the page
           * @return a bandplane instance if it has been successfully restored. 
           *         Otherwise it returns NULL.
           */
-        static BandPlane*       restoreIntoMemory(int fd);
+        static BandPlane*       restoreIntoMemory(SpillReader& reader,
+                                    Arena& arena);
 };
 
 #endif /* _BANDPLANE_H_ */
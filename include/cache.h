@@ -21,7 +21,10 @@
 #ifndef _CACHE_H_
 #define _CACHE_H_
 
+#include <sys/types.h>
+
 class Page;
+class Request;
 
 /**
   * List all the different cache policy available.
@@ -37,13 +40,18 @@ enum CachePolicy {
 
 
 /**
-  * Initialize the cache mechanism and load the cache controller thread.
+  * Initialize the cache mechanism.
+  * The memory budget, in megabytes, is read from the SPLIX_CACHE_SIZE
+  * environment variable or from the CacheSize PPD attribute. CACHESIZE is
+  * used by default.
+  * @param request the request instance
   * @return TRUE if the initialization succeed. Otherwise it returns FALSE.
   */
-extern bool initializeCache();
+extern bool initializeCache(const Request& request);
 
 /**
-  * Uninitialize the cache mechanism and unload the cache controller thread.
+  * Uninitialize the cache mechanism and free the pages which haven't been
+  * used.
   * @return TRUE if the uninitialization succeed. Otherwise it returns FALSE.
   */
 extern bool uninitializeCache();
@@ -51,17 +59,36 @@ extern bool uninitializeCache();
 
 /**
   * Extract the next page (depending on the curernt cache policy)
+  * A swapped page which cannot be restored from the disk is skipped and the
+  * next page is returned instead (see @ref hasLostPages).
   * @return the instance of the page. Otherwise it returns NULL if no page are
   *         found.
   */
 extern Page* getNextPage();
 
+/**
+  * @return TRUE if some pages have been skipped by @ref getNextPage because
+  *         they couldn't be restored from the disk. Otherwise it returns
+  *         FALSE.
+  */
+extern bool hasLostPages();
+
 /**
   * Register a new page in the cache.
+  * A page which is not complete can be registered to be rendered while its
+  * bands are compressed. In that case @ref completePage has to be called once
+  * all its bands have been registered.
   * @param page the page instance to register in the cache
   */
 extern void registerPage(Page* page);
 
+/**
+  * Mark a page registered before the end of its compression as complete.
+  * The page must not be used by the caller anymore.
+  * @param page the page instance
+  */
+extern void completePage(Page* page);
+
 /**
   * Set the new cache policy.
   * @param policy the new cache policy
@@ -77,14 +104,16 @@ extern void setNumberOfPages(unsigned long nr);
 
 /**
   * @brief This class represent a cache entry to store a page.
-  * To preserve memory a swapping mechanism is present.
+  * To preserve memory a swapping mechanism is present. All the swapped pages
+  * of a job are appended to a single swap file and the entry keeps the
+  * location of its page in this file.
   */
 class CacheEntry {
     protected:
         Page*                   _page;
-        CacheEntry*             _previous;
-        CacheEntry*             _next;
-        char*                   _tempFile;
+        bool                    _swapped;
+        off_t                   _offset;
+        unsigned long           _swapSize;
 
     public:
         /**
@@ -98,17 +127,6 @@ class CacheEntry {
         virtual ~CacheEntry();
 
     public:
-        /**
-          * Set the next cache entry.
-          * @param entry the next cache entry
-          */
-        void                    setNext(CacheEntry *entry) {_next = entry;}
-        /**
-          * Set the previous cache entry.
-          * @param entry the previous cache entry
-          */
-        void                    setPrevious(CacheEntry *entry) 
-                                    {_previous = entry;}
         /**
           * Swap the page instance on the disk.
           * @return TRUE if the page has been successfully swapped. Otherwise it
@@ -121,25 +139,20 @@ class CacheEntry {
           *         it returns FALSE.
           */
         bool                    restoreIntoMemory();
+        /**
+          * Forget the page swapped on the disk. It will never be restored.
+          */
+        void                    discard();
 
         /**
           * @return the page instance.
           */
         Page*                   page() const {return _page;}
-        /**
-          * @return the next instance.
-          */
-        CacheEntry*             next() const {return _next;}
-        /**
-          * @return the previous instance.
-          */
-        CacheEntry*             previous() const {return _previous;}
         /**
          * @return TRUE if the page is currently swapped on disk. Otherwise
          *         returns FALSE.
          */
-        bool                    isSwapped() const 
-                                    {return _tempFile ? true : false;}
+        bool                    isSwapped() const {return _swapped;}
 };
 #endif /* _CACHE_H_ */
 
@@ -23,14 +23,15 @@
 
 #ifndef DISABLE_BLACKOPTIM
 
-class Page;
-
 /**
-  * Optimize the black channel.
+  * Optimize the black channel of a part of the four color planes.
   * Transform red, green and cyan dots in a black dot and remove red, green or
   * cyan dot if a black dot is present.
+  * @param planes the cyan, magenta, yellow and black buffers
+  * @param size the size in bytes of each buffer
   */
-extern void applyBlackOptimization(Page* page);
+extern void applyBlackOptimization(unsigned char* planes[4],
+    unsigned long size);
 
 #endif /* DISABLE_BLACKOPTIM */
 #endif /* _COLORS_H_ */
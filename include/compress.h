@@ -23,9 +23,57 @@
 
 class Page;
 class Request;
+class Document;
 
+/**
+  * Compress the bitmap of a page loaded into memory.
+  * @param request the request instance
+  * @param page the page to compress
+  * @return TRUE if the page has been compressed. Otherwise it returns FALSE.
+  */
 extern bool compressPage(const Request& request, Page* page);
 
+/**
+  * Tell if a page can be read and compressed band by band.
+  * @param request the request instance
+  * @param page the page which has just been read
+  * @return TRUE if the page can be streamed. Otherwise it returns FALSE.
+  */
+extern bool canStreamPage(const Request& request, const Page* page);
+
+/**
+  * Compute the final geometry of a streamed page.
+  * It has to be called before @ref compressStreamedPage. The page header can
+  * then be rendered while the bands are compressed.
+  * @param request the request instance
+  * @param page the streamed page
+  */
+extern void prepareStreamedPage(const Request& request, Page* page);
+
+/**
+  * Read the bitmap of a streamed page band by band and compress each band
+  * while the next ones are read. Each band is registered into the page, in
+  * order, as soon as it is compressed.
+  * @param request the request instance
+  * @param page the streamed page
+  * @param document the document from which the bitmap is read
+  * @return TRUE if the page has been compressed. Otherwise it returns FALSE.
+  */
+extern bool compressStreamedPage(const Request& request, Page* page,
+    Document& document);
+
+/**
+  * Report how often the bands unsuited to algorithm 0xd have been predicted
+  * and sent directly to algorithm 0xe.
+  */
+extern void reportCompressionStatistics();
+
+/**
+  * Release the encoders and the band buffers kept by the compression threads
+  * between the bands.
+  */
+extern void releaseEncoders();
+
 #endif /* _COMPRESS_H_ */
 
 /* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
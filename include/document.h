@@ -39,6 +39,29 @@ class Document
         unsigned long           _currentPage;
         bool                    _lastPage;
 
+        // Geometry of the page being read
+        unsigned char*          _line;
+        unsigned char           _colors;
+        bool                    _streaming;
+        bool                    _rotate;
+        unsigned long           _lineSize;
+        unsigned long           _pageWidthInB;
+        unsigned long           _pageHeight;
+        unsigned long           _marginWidthInB;
+        unsigned long           _clippingX;
+        unsigned long           _bytesToCopy;
+        unsigned long           _firstLine;
+        unsigned long           _linesToCopy;
+        unsigned long           _linesToSkip;
+        unsigned long           _currentLine;
+
+    protected:
+        Page*                   _readPageHeader(const Request& request);
+        bool                    _skipRasterLines(unsigned long nr);
+        bool                    _loadPlanes(unsigned char** planes,
+                                    unsigned char* ink);
+        void                    _closePage();
+
     public:
         /**
           * Initialize the instance.
@@ -65,10 +88,40 @@ class Document
           * in a @ref Page instance.
           * If the page is empty, it means there is no more pages (check the
           * @ref noMorePages method) or there is an error.
+          * A color page loaded into memory which has no cyan, magenta or
+          * yellow dots only keeps its black plane. A page without any dot
+          * keeps no plane at all and is marked as blank.
           * @param request the request instance
           * @return a @ref Page instance containing the current page.
           */
         Page*                   getNextRawPage(const Request& request);
+        /**
+          * Tell if the bitmap of the page returned by @ref getNextRawPage
+          * has to be read band by band.
+          * In this case, the page returned doesn't contain any plane buffer
+          * and its bitmap has to be read with @ref readLines before the next
+          * call to @ref getNextRawPage.
+          * @return TRUE if the page is streamed. Otherwise it returns FALSE.
+          */
+        bool                    isStreaming() const {return _streaming;}
+        /**
+          * Read the next lines of the current page.
+          * Each plane buffer receives the lines of one color. Lines outside
+          * the printable area are cleared. The end of the raster page is
+          * skipped once its last line has been read.
+          * The black optimization is applied to each line while it is read.
+          * The colors inked by each line can be recorded too: the bit N of a
+          * line is set if the color N has a dot on it.
+          * @param planes the plane buffers
+          * @param nr the number of lines to read
+          * @param ink the buffer of nr bytes where the colors inked by each
+          *        line are recorded or NULL
+          * @return TRUE if the lines have been read. Otherwise it returns
+          *         FALSE.
+          */
+        bool                    readLines(unsigned char** planes,
+                                    unsigned long nr, 
+                                    unsigned char* ink = NULL);
         /**
           * @return the number of pages or 0 if its number is not yet known.
           */
@@ -0,0 +1,75 @@
+/*
+ * 	    kernels.h                 (C) 2008, Aurélien Croc (AP²C)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the
+ *  Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ *  $Id$
+ * 
+ */
+#ifndef _KERNELS_H_
+#define _KERNELS_H_
+
+/**
+  * Select the fastest implementation of the kernels the CPU supports.
+  * The portable implementations are used until it is called.
+  */
+extern void initializeKernels();
+
+/**
+  * Select an implementation of the kernels.
+  * @param name the instruction set to use: "portable", "SSE2", "AVX2" or
+  *        "AVX-512"
+  * @return TRUE if the CPU supports it. Otherwise it returns FALSE and the
+  *         kernels in use are kept.
+  */
+extern bool selectKernels(const char* name);
+
+/**
+  * @return the name of the instruction set used by the kernels.
+  */
+extern const char* kernelsName();
+
+/**
+  * Check if a buffer only contains one byte value.
+  * @param data the buffer
+  * @param size the size of the buffer
+  * @param blank the byte value of a blank buffer
+  * @return TRUE if all the bytes are equal to the blank value. Otherwise it
+  *         returns FALSE.
+  */
+extern bool isBlankBuffer(const unsigned char* data, unsigned long size,
+    unsigned char blank);
+
+/**
+  * Reverse a buffer bit by bit.
+  * The last bit of the buffer becomes the first one and so on. This rotates
+  * a bitmap by 180 degrees.
+  * @param data the buffer
+  * @param size the size of the buffer
+  */
+extern void reverseBuffer(unsigned char* data, unsigned long size);
+
+/**
+  * Replace the cyan, magenta and yellow dots printed at the same place by a
+  * black dot and remove the colored dots under the black ones.
+  * @param planes the cyan, magenta, yellow and black planes
+  * @param size the size of each plane
+  */
+extern void optimizeBlack(unsigned char* planes[4], unsigned long size);
+
+#endif /* _KERNELS_H_ */
+
+/* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
+
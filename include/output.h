@@ -0,0 +1,75 @@
+/*
+ * 	    output.h                  (C) 2008, Aurélien Croc (AP²C)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the
+ *  Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ *  $Id$
+ * 
+ */
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+/*
+ * The QPDL and PJL data are gathered into large buffers which are sent to the
+ * printer by a writer thread. The rendering thread only blocks when all the
+ * buffers are waiting to be sent.
+ */
+
+/**
+  * Initialize the output mechanism and load the writer thread.
+  * @return TRUE if the initialization succeed. Otherwise it returns FALSE.
+  */
+extern bool initializeOutput();
+
+/**
+  * Send the pending data, wait for the writer thread and unload it.
+  * @return TRUE if all the data have been sent to the printer. Otherwise it
+  *         returns FALSE.
+  */
+extern bool uninitializeOutput();
+
+/**
+  * Append data to the output.
+  * The data are copied so they can be released as soon as this function
+  * returns.
+  * @param data the data to send
+  * @param size the size of the data
+  * @return TRUE if the data have been appended. Otherwise it returns FALSE if
+  *         an error occurred while sending data to the printer.
+  */
+extern bool writeOutput(const void* data, unsigned long size);
+
+/**
+  * Append a formatted string to the output.
+  * @param format the printf-like format of the string
+  * @return TRUE if the string has been appended. Otherwise it returns FALSE if
+  *         an error occurred while sending data to the printer.
+  */
+extern bool printOutput(const char* format, ...)
+    __attribute__((format(printf, 1, 2)));
+
+/**
+  * Hand the pending data to the writer thread without waiting.
+  * It has to be called when the printer needs the data as soon as possible,
+  * for example at the end of a page.
+  * @return TRUE if no error occurred while sending data to the printer.
+  *         Otherwise it returns FALSE.
+  */
+extern bool flushOutput();
+
+#endif /* _OUTPUT_H_ */
+
+/* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
+
@@ -22,8 +22,14 @@
 #define _PAGE_H_
 
 #include <stddef.h>
+#include "arena.h"
+#ifndef DISABLE_THREADS
+#include <pthread.h>
+#endif /* DISABLE_THREADS */
 
 class Band;
+class SpillReader;
+class SpillWriter;
 
 /**
   * @brief This class contains a page representation.
@@ -35,6 +41,13 @@ class Band;
   *
   * When the page will be compressed this instance have to be sent to the cache
   * manager for waiting its use by the render code.
+  *
+  * The bands, their planes and the compressed data are allocated in the arena
+  * of the page and are all released with it.
+  *
+  * A page can be sent to the render code before all its bands are compressed.
+  * In that case the page is not complete and its bands are rendered one by
+  * one as soon as they are registered.
   */
 class Page
 {
@@ -48,11 +61,19 @@ class Page
         unsigned long           _copiesNr;
         unsigned long           _compression;
         unsigned char*          _planes[4];
+        unsigned char*          _inkLines;
         bool                    _empty;
+        bool                    _blank;
         unsigned long           _bandsNr;
         unsigned char*          _bih;
         Band*                   _firstBand;
         Band*                   _lastBand;
+        Arena                   _arena;
+        bool                    _complete;
+#ifndef DISABLE_THREADS
+        pthread_mutex_t         _bandsLock;
+        pthread_cond_t          _bandsCond;
+#endif /* DISABLE_THREADS */
 
     public:
         /**
@@ -87,11 +108,6 @@ class Page
           */
         void                    flushPlanes();
 
-        /**
-          * Make a 180° rotation of the bitmap planes
-          */
-        void                    rotate();
-
     public:
         /**
           * Set the X resolution.
@@ -147,10 +163,22 @@ class Page
         void                    setPlaneBuffer(unsigned char color,
                                     unsigned char* buffer) 
                                     {_planes[color] = buffer; _empty = false;}
+        /**
+          * Register the colors inked by each line of the planes.
+          * The bit N of a line is set if the color N has a dot on it. The
+          * buffer is freed with the planes.
+          * @param buffer the ink buffer, with one byte per line.
+          */
+        void                    setInkLines(unsigned char* buffer)
+                                    {_inkLines = buffer;}
+        /**
+          * Set this page blank.
+          * A blank page has no planes and is rendered without any band.
+          */
+        void                    setBlank() {_blank = true;}
         /**
           * Register a new band.
-          * Note that band instances will be destroyed when this instance will
-          * be destroyed.
+          * The band instance has to be allocated in the arena of this page.
           * @param band the band instance.
           */ 
         void                    registerBand(Band *band);
@@ -159,6 +187,12 @@ class Page
          * This is useful in case of compression error.
          */
         void                    setEmpty() {_empty = true;}
+        /**
+          * Tell if all the bands of this page have been registered.
+          * The threads waiting for the next band are woken up.
+          * @param complete TRUE if no more bands will be registered
+          */
+        void                    setComplete(bool complete);
 
         /**
           * @return the X resolution.
@@ -206,30 +240,61 @@ class Page
         unsigned char*          planeBuffer(unsigned char color) const
                                     {return color < _colors ? _planes[color] :
                                         NULL;}
+        /**
+          * @return the colors inked by each line of the planes or NULL if
+          *         they are not known.
+          */
+        const unsigned char*    inkLines() const {return _inkLines;}
         /**
           * @return TRUE if no planes has been set. Otherwise it returns FALSE.
           */ 
         bool                    isEmpty() const {return _empty;}
+        /**
+          * @return TRUE if the page has no dots. Otherwise it returns FALSE.
+          */
+        bool                    isBlank() const {return _blank;}
         /**
           * @return the first band or NULL if no bands has been registered.
           */ 
         const Band*             firstBand() const {return _firstBand;}
+        /**
+          * Get the band following another one.
+          * If this page is not complete, it waits for the registration of 
+          * the next band.
+          * @param band the current band or NULL to get the first band
+          * @return the next band or NULL if there is no more bands.
+          */
+        const Band*             nextBand(const Band* band);
+        /**
+          * @return TRUE if all the bands of this page have been registered.
+          */
+        bool                    isComplete() const {return _complete;}
+        /**
+          * @return the arena where the bands of the page are allocated.
+          */
+        Arena&                  arena() {return _arena;}
+        /**
+          * @return the memory used by the bands of the page in bytes.
+          */
+        unsigned long           memorySize() const;
 
     public:
         /**
-          * Swap this instance on the disk.
-          * @param fd the file descriptor where the instance has to be swapped
+          * Serialize this instance to swap it on the disk.
+          * @param writer the writer which gathers the serialized instance
           * @return TRUE if the instance has been successfully swapped. 
           *         Otherwise it returns FALSE.
           */
-        bool                    swapToDisk(int fd);
+        bool                    swapToDisk(SpillWriter& writer);
         /**
-          * Restore an instance from the disk into memory.
-          * @param fd the file descriptor where the instance has been swapped
-          * @return a page instance if it has been successfully restored. 
-          *         Otherwise it returns NULL.
+          * Restore this instance from the disk into memory.
+          * The compressed data are not copied: the serialized instance has
+          * to be stored in the arena of this instance.
+          * @param reader the reader of the serialized instance
+          * @return TRUE if the instance has been successfully restored. 
+          *         Otherwise it returns FALSE.
           */
-        static Page*            restoreIntoMemory(int fd);
+        bool                    restoreIntoMemory(SpillReader& reader);
         /**
           * Register an independent copy of the BIH data. 
           * @param bih_data the BIH for JBIG data.
@@ -0,0 +1,51 @@
+/*
+ * 	    planepool.h               (C) 2008, Aurélien Croc (AP²C)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the
+ *  Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ *  $Id$
+ * 
+ */
+#ifndef _PLANEPOOL_H_
+#define _PLANEPOOL_H_
+
+/**
+  * Allocate a plane buffer.
+  * A buffer of the same size released by a previous page is reused if there
+  * is one. Otherwise a new buffer is allocated and large buffers are backed
+  * by huge pages when the system supports them. The content of the buffer is
+  * undefined.
+  * @param size the size of the plane buffer
+  * @return the plane buffer or NULL if there is not enough memory.
+  */
+extern unsigned char* allocatePlane(unsigned long size);
+
+/**
+  * Give a plane buffer back to the pool.
+  * The pool keeps the buffers most recently released for the next pages and
+  * frees the other ones.
+  * @param plane the plane buffer or NULL
+  */
+extern void releasePlane(unsigned char* plane);
+
+/**
+  * Free all the plane buffers kept by the pool.
+  */
+extern void releasePlanePool();
+
+#endif /* _PLANEPOOL_H_ */
+
+/* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
+
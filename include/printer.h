@@ -77,9 +77,10 @@ class Printer
 
         /**
           * Send the PJL header.
-          * The PJL header will be sent to STDOUT. Like the other methods which
-          * send data to the printer, if you need to redirect the data to
-          * somewhere else, use the freopen function to redirect STDOUT.
+          * The PJL header will be sent to STDOUT by the output writer thread.
+          * Like the other methods which send data to the printer, if you need
+          * to redirect the data to somewhere else, use the freopen function to
+          * redirect STDOUT.
           * @return TRUE if it succeed. Otherwise it returns FALSE.
           */
         bool                    sendPJLHeader(const Request& request,
@@ -90,6 +90,19 @@ class Request
                                     const char *jobname, const char *username, 
                                     const char *jobtitle, 
                                     unsigned long copiesNr);
+        /**
+          * Get a tuning value of the filter.
+          * The environment variable takes precedence over the PPD attribute
+          * of the QPDL group.
+          * @param name the PPD attribute name
+          * @param envName the environment variable name
+          * @param defaultValue the value to use if none of them is set or if
+          *        the value set isn't a number
+          * @return the tuning value.
+          */
+        unsigned long           tuningValue(const char *name, 
+                                    const char *envName,
+                                    unsigned long defaultValue) const;
 
     public:
         /**
@@ -0,0 +1,140 @@
+/*
+ * 	    spill.h                   (C) 2008, Aurélien Croc (AP²C)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the
+ *  Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ *  $Id$
+ * 
+ */
+#ifndef _SPILL_H_
+#define _SPILL_H_
+
+#include <sys/types.h>
+
+/**
+  * @brief This class gathers the serialized representation of an instance to
+  *        swap on the disk.
+  *
+  * Small fields are copied into an internal buffer whereas large buffers are
+  * only referenced. The whole representation is then written with vectored
+  * writes. Referenced buffers have to stay valid until it has been written.
+  */
+class SpillWriter
+{
+    protected:
+        typedef struct {
+            const unsigned char* data;
+            unsigned long       offset;
+            unsigned long       size;
+        } segment_t;
+
+    protected:
+        segment_t*              _segments;
+        unsigned long           _segmentsNr;
+        unsigned long           _maxSegmentsNr;
+        unsigned char*          _fields;
+        unsigned long           _fieldsSize;
+        unsigned long           _maxFieldsSize;
+        unsigned long           _size;
+
+    protected:
+        void                    _appendSegment(const unsigned char* data, 
+                                    unsigned long offset, unsigned long size);
+
+    public:
+        /**
+          * Initialize the instance.
+          */
+        SpillWriter();
+        /**
+          * Destroy the instance.
+          */
+        virtual ~SpillWriter();
+
+    public:
+        /**
+          * Copy a small field into the representation.
+          * @param data the field
+          * @param size the size of the field
+          */
+        void                    copy(const void* data, unsigned long size);
+        /**
+          * Reference a buffer in the representation.
+          * @param data the buffer
+          * @param size the size of the buffer
+          */
+        void                    reference(const void* data, 
+                                    unsigned long size);
+
+        /**
+          * Write the representation into a file.
+          * @param fd the file descriptor
+          * @param offset the offset in the file where to write it
+          * @return TRUE if it has been successfully written. Otherwise it
+          *         returns FALSE.
+          */
+        bool                    writeAt(int fd, off_t offset) const;
+
+        /**
+          * @return the size of the representation.
+          */
+        unsigned long           size() const {return _size;}
+};
+
+/**
+  * @brief This class reads the serialized representation of an instance
+  *        restored from the disk.
+  */
+class SpillReader
+{
+    protected:
+        const unsigned char*    _data;
+        unsigned long           _size;
+        unsigned long           _position;
+
+    public:
+        /**
+          * Initialize the instance.
+          * @param data the representation
+          * @param size the size of the representation
+          */
+        SpillReader(const unsigned char* data, unsigned long size);
+        /**
+          * Destroy the instance.
+          */
+        virtual ~SpillReader();
+
+    public:
+        /**
+          * Read the next bytes of the representation.
+          * @param data the buffer where to copy them
+          * @param size the number of bytes to read
+          * @return TRUE if they have been read. Otherwise it returns FALSE if
+          *         the representation is too short.
+          */
+        bool                    read(void* data, unsigned long size);
+        /**
+          * Get the next bytes of the representation without copying them.
+          * @param size the number of bytes to get
+          * @return a pointer to these bytes in the representation. Otherwise
+          *         it returns NULL if the representation is too short.
+          */
+        const unsigned char*    map(unsigned long size);
+};
+
+#endif /* _SPILL_H_ */
+
+/* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
+
@@ -0,0 +1,145 @@
+/*
+ * 	    workerpool.h              (C) 2008, Aurélien Croc (AP²C)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the
+ *  Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ *  $Id$
+ * 
+ */
+#ifndef _WORKERPOOL_H_
+#define _WORKERPOOL_H_
+
+#include "semaphore.h"
+
+class JobGroup;
+
+/**
+  * @brief This super class is an interface to implement a job executed by the
+  *        worker pool.
+  */
+class Job
+{
+    friend class JobGroup;
+
+    protected:
+        Job*                    _nextJob;
+        JobGroup*               _group;
+
+    public:
+        /**
+          * Initialize the instance.
+          */
+        Job();
+        /**
+          * Destroy the instance.
+          */
+        virtual ~Job();
+
+    public:
+        /**
+          * Do the work.
+          * This method can be called by any worker thread.
+          */
+        virtual void            run() = 0;
+};
+
+/**
+  * @brief This class queues jobs into the worker pool and waits for them.
+  *
+  * Jobs queued by a group are executed asynchronously. The group is used to
+  * wait for the end of all the jobs it has queued. A job instance must stay
+  * valid until the group has finished to wait for it.
+  */
+class JobGroup
+{
+    protected:
+#ifndef DISABLE_THREADS
+        Semaphore               _done;
+#endif /* DISABLE_THREADS */
+        unsigned long           _queued;
+
+    public:
+        /**
+          * Initialize the instance.
+          */
+        JobGroup();
+        /**
+          * Destroy the instance.
+          * It waits for the end of the queued jobs.
+          */
+        virtual ~JobGroup();
+
+    public:
+        /**
+          * Queue jobs into the worker pool.
+          * If the worker pool has not been loaded, the jobs are executed
+          * immediately one after another.
+          * @param jobs the jobs to queue
+          * @param nr the number of jobs
+          */
+        void                    queue(Job** jobs, unsigned long nr);
+        /**
+          * Wait for the end of all the jobs queued by this group.
+          * The calling thread executes queued jobs too while it is waiting.
+          */
+        void                    wait();
+
+    public:
+        /**
+          * Execute the next queued job.
+          * @return TRUE if a job has been executed. Otherwise it returns FALSE
+          *         if the queue was empty.
+          */
+        static bool             runQueuedJob();
+};
+
+
+/**
+  * Compute the number of CPUs the filter can use.
+  * It takes into account the online CPUs, the CPU affinity of the process and
+  * the CPU quota of its control group.
+  * @return the number of CPUs available.
+  */
+extern unsigned long availableCPUsNr();
+
+/**
+  * Initialize the worker pool.
+  * The worker threads are loaded on demand when jobs are queued, so that a
+  * small job does not load more threads than it needs. Without worker
+  * threads, the jobs are executed by the threads which queue them.
+  * @param threadsNr the maximum number of worker threads to load
+  * @return TRUE if the initialization succeed. Otherwise it returns FALSE.
+  */
+extern bool initializeWorkerPool(unsigned long threadsNr);
+
+/**
+  * Uninitialize the worker pool and unload the worker threads.
+  * @return TRUE if the uninitialization succeed. Otherwise it returns FALSE.
+  */
+extern bool uninitializeWorkerPool();
+
+/**
+  * Execute a list of jobs in parallel and wait until all of them are done.
+  * The calling thread executes queued jobs too while it is waiting. If the
+  * worker pool has not been loaded, the jobs are executed one after another.
+  * @param jobs the jobs to execute
+  * @param nr the number of jobs
+  */
+extern void runJobs(Job** jobs, unsigned long nr);
+
+#endif /* _WORKERPOOL_H_ */
+
+/* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
+
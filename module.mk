@@ -19,7 +19,7 @@ PRE_GENERIC_TARGETS	:= optionList
 
 
 # Default options
-THREADS			?= 2
+THREADS			?= 0
 CACHESIZE		?= 30
 DISABLE_JBIG		?= 0
 DISABLE_THREADS		?= 0
@@ -47,6 +47,25 @@ installcms:
 
 
 
+# Unit tests of the kernels
+kernelstest_TARGET	:= $(TARGETDIR)/kernelstest
+kernelstest_OBJ		:= $(BUILDDIR)/tests/kernels.o $(BUILDDIR)/src/kernels.o
+
+.PHONY: check cleancheck
+cmd_check		= CHECK             $(kernelstest_TARGET)
+$(kernelstest_TARGET): $(kernelstest_OBJ)
+	$(call printCmd, $(cmd_link))
+	$(Q)g++ -o $@ $^
+
+check: $(kernelstest_TARGET)
+	$(call printCmd, $(cmd_check))
+	$(Q)$(kernelstest_TARGET)
+
+clean: cleancheck
+cleancheck:
+	$(Q)$(RM) $(kernelstest_OBJ) $(kernelstest_TARGET)
+
+
 # Specific rules used for development and information
 
 .PHONY: tags optionList drv ppd cleanppd
@@ -72,6 +91,11 @@ THREADSSTATE := disabled
 else
 THREADSSTATE := enabled
 endif
+ifeq ($(THREADS),0)
+THREADSNR := auto
+else
+THREADSNR := $(THREADS)
+endif
 ifneq ($(DISABLE_BLACKOPTIM),0)
 BLACKOPTIMSTATE := disabled
 else
@@ -88,13 +112,13 @@ MSG	:=    +---------------------------------------------+\n
 MSG	+=    |      COMPILATION PARAMETERS SUMMARY         |\n
 MSG	+=    +---------------------------------------------+\n
 MSG	+=    |      THREADS     = %8s                 |\n
-MSG	+=    |      THREADS Nr  = %8i                 |\n
-MSG	+=    |      CACHESIZE   = %8i                 |\n
+MSG	+=    |      THREADS Nr  = %8s                 |\n
+MSG	+=    |      CACHESIZE   = %8i MB              |\n
 MSG	+=    |      JBIG        = %8s                 |\n
 MSG	+=    |      BLACK OPTIM = %8s                 |\n
 MSG	+=    |      DRV ONLY    = %8s                 |\n
 MSG	+=    +---------------------------------------------+\n
 MSG	+=   (Do a \"make clean\" before updating these values)\n\n
 optionList:
-	@printf " $(MSG)" $(THREADSSTATE) $(THREADS) $(CACHESIZE) $(JBIGSTATE) \
+	@printf " $(MSG)" $(THREADSSTATE) $(THREADSNR) $(CACHESIZE) $(JBIGSTATE) \
 		$(BLACKOPTIMSTATE) $(DRVSTATE)
@@ -26,6 +26,7 @@
 #include <string.h>
 #include "errlog.h"
 #include "request.h"
+#include "arena.h"
 #include "printer.h"
 #include "bandplane.h"
 
@@ -226,11 +227,140 @@ inline void Algo0x0D::selectPacketSize(
 
 
 
+/*
+ * Load the 64 pixels which begin at the given byte of a scan-line.
+ * The first pixel is stored in the most significant bit. Bytes past the
+ * end of the scan-line are read as blank pixels.
+ */
+inline uint64_t Algo0x0D::loadPixelsWord( const unsigned char * data,
+                            unsigned long byteIndex,
+                            unsigned long rowBytes )
+{
+    uint64_t word = 0;
+
+#if defined( __BYTE_ORDER__ ) && \
+    ( __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ || \
+      __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__ )
+    /* Load a whole word when the scan-line is long enough. */
+    if ( byteIndex + sizeof( word ) <= rowBytes ) {
+        memcpy( &word, data + byteIndex, sizeof( word ) );
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        word = __builtin_bswap64( word );
+#endif
+        return word;
+    }
+#endif /* __BYTE_ORDER__ */
+
+    /* Otherwise complete the last bytes with blank pixels. */
+    for ( unsigned long i = 0; i < sizeof( word ); i++ ) {
+        word <<= 8;
+        if ( byteIndex + i < rowBytes ) {
+            word |= data[ byteIndex + i ];
+        }
+    }
+
+    return word;
+}
+
+
+
+/*
+ * Find the first black (or blank) pixel of a scan-line from the given pixel.
+ * The scan-line is examined 64 pixels at a time so that a whole run of
+ * pixels is skipped with a single count-leading-zeros operation.
+ * Returns the working width if there is no such pixel.
+ */
+inline unsigned long Algo0x0D::findPixel( const unsigned char * data,
+                            unsigned long pixelIndex,
+                            unsigned long workWidth,
+                            unsigned long rowBytes,
+                            bool black )
+{
+    while ( pixelIndex < workWidth ) {
+        /* Only the first word may not begin on a byte boundary. */
+        unsigned long shift = pixelIndex & 7;
+        uint64_t word = loadPixelsWord( data, pixelIndex >> 3, rowBytes );
+
+        /* Looking for a blank pixel is looking for an unset bit. The padding
+           past the scan-line is then seen as blank, beyond the working
+           width. */
+        if ( !black ) {
+            word = ~word;
+        }
+        word <<= shift;
+
+        if ( word ) {
+            pixelIndex += __builtin_clzll( word );
+            break;
+        }
+        pixelIndex += 64 - shift;
+    }
+
+    return ( pixelIndex < workWidth ) ? pixelIndex : workWidth;
+}
+
+
+
+/*
+ * Predict if the encoding of a band will be given up.
+ */
+bool Algo0x0D::mustGiveUp(const unsigned char * data, unsigned long width,
+        unsigned long height)
+{
+    /* Let the encoder report invalid bands. */
+    if ( !data || !width || ! ( 128 == height || 64 == height ) ) {
+        return false;
+    }
+
+    /* Same limits as the encoder. */
+    const unsigned long wrapWidth = ( 64 == height ) ? 0x09A0 : 0x1360;
+    const unsigned long maxEncodedBytesPerScanLine = ( 64 == height ) ?
+        250 : 122;
+    const unsigned long rowBytes = ( width + 7 ) / 8;
+    const unsigned long workWidth = ( width > wrapWidth ) ? wrapWidth : width;
+    const unsigned long workWidthRowBytes = ( workWidth + 7 ) / 8;
+
+    for ( unsigned long y = 0; y < height; y++ ) {
+        /* Number of runs of black pixels in the scan-line. */
+        unsigned long runs = 0;
+
+        /* Previous pixels of the scan-line. */
+        uint64_t previousWord = 0;
+
+        for ( unsigned long pixelIndex = 0; pixelIndex < workWidth;
+                                                pixelIndex += 64 ) {
+            uint64_t word = loadPixelsWord( data, pixelIndex >> 3,
+                                workWidthRowBytes );
+
+            /* Ignore the pixels past the working width. */
+            if ( workWidth - pixelIndex < 64 ) {
+                word &= ~( uint64_t )0 << ( 64 - ( workWidth - pixelIndex ) );
+            }
+
+            /* A run begins with a black pixel which follows a blank one. */
+            runs += __builtin_popcountll( word &
+                                ~( ( word >> 1 ) | ( previousWord << 63 ) ) );
+            previousWord = word;
+        }
+
+        /* Each run is encoded at least as a two-byte packet. */
+        if ( 2 * runs > maxEncodedBytesPerScanLine ) {
+            return true;
+        }
+
+        data = & data[ rowBytes ];
+    }
+
+    return false;
+}
+
+
+
 /*
  * Main algorithm 0xd encoder.
  */
 BandPlane * Algo0x0D::compress(const Request & request, unsigned char *data,
-        unsigned long width, unsigned long height)
+        unsigned long width, unsigned long height, Arena & arena)
 {
     /* Basic parameters validation. */
     if ( !data || !height || !width ) {
@@ -262,30 +392,31 @@ BandPlane * Algo0x0D::compress(const Request & request, unsigned char *data,
     /* Keep track of the size of encoded data. */
     unsigned long outputSize = 0;
 
+    /* Sum of the encoded bytes, kept while the packets are written. */
+    unsigned long checksum = 0;
+
     /* Encoded data size of current scan-line. */
     unsigned long encodedScanLineSize = 0;
 
-    /* Create the output buffer for work. */
-    unsigned char * output = NULL;
+    /* Reserve the output buffer in the arena and encode straight into it. */
+    unsigned char * output = arena.reserve( maximumBufferSize );
 
-    try {
-        output = new unsigned char[ maximumBufferSize ];
-    } catch( std::bad_alloc & ) {
+    if ( ! output ) {
         ERRORMSG(_("Could not allocate work buffer for compression: 0xd"));
         return NULL;
     }
 
-    /* Mask to track the bits in raw data-byte that is being processed. */
-    unsigned char bitMask = 0x80;
-
     /* Accumulation of the number of (black) pixel runs. */
     unsigned long accumulatedRunCount = 0;
 
     /* Accumulation of horizontal offset value in pixels. */
     unsigned long accumulatedHorizontalOffsetValue = 0;
 
-    /* Index for the raw data byte in the current scanline. */
-    unsigned long rowByteIndex = 0;
+    /* Index of the next pixel to process in the current scan-line. */
+    unsigned long pixelIndex = 0;
+
+    /* Index of the first pixel of the current run. */
+    unsigned long runIndex = 0;
 
     /* Current absolute horizontal pen position. */
     unsigned long currentHorizontalPenPosition = 0;
@@ -307,70 +438,21 @@ BandPlane * Algo0x0D::compress(const Request & request, unsigned char *data,
      number of pixels. */
     const unsigned long workWidthRowBytes = ( workWidth + 7 ) / 8;
 
-    /* Number of pixels left to be processed in the scanline. */
-    unsigned long pixelsLeftInScanline = workWidth;
-
     /* Number of acumulated consecutive blank scanline. */
     unsigned long consecutiveBlankScanLines = 0;
 
     /* Main encoding loop. */
     while ( currentVerticalPenPosition < height ) {
 
-        /* Scan for offset value. */
-        while ( rowByteIndex < workWidthRowBytes ) {
-
-            /* Check current byte data against the mask for a unset bit. */
-            if ( ( 0 == ( bitMask & data[ rowByteIndex ] ) ) &&
-                                                ( pixelsLeftInScanline > 0 ) ) {
-                /* Account for a blank pixel. */
-                accumulatedHorizontalOffsetValue++;
-
-                /* Make a discount for previous processed pixel. */
-                pixelsLeftInScanline--;
-            } else {
-                /* Exit current loop for scanning of offset values. */
-                break;
-            }
+        /* Scan for offset value, up to the next black pixel. */
+        runIndex = findPixel( data, pixelIndex, workWidth,
+                                workWidthRowBytes, true );
+        accumulatedHorizontalOffsetValue = runIndex - pixelIndex;
 
-            /* Rotating the bit mask. */
-            bitMask >>= 1;
-
-            /* Reset the mask if needed. */
-            if ( 0 == bitMask ) {
-                bitMask = 0x80;
-
-                /* Advance the row byte index. */
-                rowByteIndex++;
-            }
-        }
-
-        /* Now, scan for run count. */
-        while ( rowByteIndex < workWidthRowBytes ) {
-
-            /* Check byte against the mask for an one-bit (set) value. */
-            if ( ( 0 != ( bitMask & data[ rowByteIndex ] ) ) &&
-                                            ( pixelsLeftInScanline > 0 ) ) {
-                /* Account for a black pixel. */
-                accumulatedRunCount++;
-
-                /* Make a discount for previous processed pixel. */
-                pixelsLeftInScanline--;
-            } else {
-                /* Exit current loop for scanning of run count. */
-                break;
-            }
-
-            /* Rotating the bit mask. */
-            bitMask >>= 1;
-
-            /* Reset the mask if needed. */
-            if ( 0 == bitMask ) {
-                bitMask = 0x80;
-
-                /* Advance the row byte index. */
-                rowByteIndex++;
-            }
-        }
+        /* Now, scan for run count, up to the next blank pixel. */
+        pixelIndex = findPixel( data, runIndex, workWidth,
+                                workWidthRowBytes, false );
+        accumulatedRunCount = pixelIndex - runIndex;
 
         /* We have an offset value and a run count pair. */
         /* Verify if it's a blank scanline before proceeding. */
@@ -393,31 +475,35 @@ BandPlane * Algo0x0D::compress(const Request & request, unsigned char *data,
             } else {
                 /* Here we failed. Unlikely. */
                 ERRORMSG(_("Out of buffer space: 0xd"));
-                delete [] output;
+                arena.release( output );
                 return NULL;
             }
 
             encodedScanLineSize += ( outputSize - previousOutputSize );
 
+            /* Add the packet just written to the checksum. */
+            for ( unsigned long i = previousOutputSize; i < outputSize; i++ ) {
+                checksum += output[ i ];
+            }
+
             if ( maxEncodedBytesPerScanLine < encodedScanLineSize ) {
                 /* We did not fail, but gave up because data is unsuited for
                  encoding by this algorithm. */
-                delete [] output;
+                arena.release( output );
                 return NULL;
             }
 
             /* After encoding, reset the blank scan-line counter. */
             consecutiveBlankScanLines = 0;
 
-            /* Update the pen position. This is one way of doing it. */
-            currentHorizontalPenPosition =
-                        workWidth - pixelsLeftInScanline - accumulatedRunCount;
+            /* Update the pen position to the beginning of the run. */
+            currentHorizontalPenPosition = runIndex;
 
             /* Must pre-accumulate the offset value. */
             preAccumulatedHorizontalOffsetValue = accumulatedRunCount;
         }
 
-        if ( 0 == pixelsLeftInScanline ) {
+        if ( workWidth == pixelIndex ) {
             /* Advance the vertical pen position. */
             if ( ++currentVerticalPenPosition < height ) {
 		/* No more pixels left in this scan-line, so go to the next one. */
@@ -428,21 +514,11 @@ BandPlane * Algo0x0D::compress(const Request & request, unsigned char *data,
             encodedScanLineSize = 0;
 
             /* Reset control variables to initial values. */
-            rowByteIndex = 0;
-
-            /* Reset the bit mask. */
-            bitMask = 0x80;
-
-            /* Re-init the working width. */
-            pixelsLeftInScanline = workWidth;
+            pixelIndex = 0;
 
             /* Reset the pre-accumulated offset value at each scan-line done. */
             preAccumulatedHorizontalOffsetValue = 0;
         }
-
-        /* Always reset the run count and the offset value in every pass. */
-        accumulatedRunCount = 0;
-        accumulatedHorizontalOffsetValue = 0;
     }
 
     /* Zero value byte padding for data size alignment to 4-byte boundary. */
@@ -456,14 +532,15 @@ BandPlane * Algo0x0D::compress(const Request & request, unsigned char *data,
     } else {
         /* Here we failed. Unlikely. */
         ERRORMSG(_("No buffer during padding: 0xd"));
-        delete [] output;
+        arena.release( output );
         return NULL;
     }
 
     /* Prepare to return data encoded by algorithm 0xd. */
-    BandPlane * plane = new BandPlane();
+    BandPlane * plane = new ( arena ) BandPlane();
     
-    plane->setData( output, outputSize );
+    /* Give back the unused end of the buffer. */
+    plane->setData( arena.trim( output, outputSize ), outputSize, checksum );
     plane->setEndian( BandPlane::Dependant );
     plane->setCompression( 0xd );
 
@@ -26,8 +26,12 @@
 #include <string.h>
 #include "errlog.h"
 #include "request.h"
+#include "arena.h"
 #include "printer.h"
 #include "bandplane.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
 
 #define getData(x) data[(x)]
 
@@ -76,7 +80,7 @@ inline void Algo0x0E::addLiteralSequence(
 
     /* Pad with required blanks. */
     for(w=0;w<blanks;w++){
-        data[outputSize++] = 0xff;
+        output[outputSize++] = 0xff;
     }
 }
 
@@ -103,6 +107,119 @@ inline void Algo0x0E::addReplicativeRun(
 
 
 
+/*
+ * Neighbor comparisons.
+ * With SSE2, 16 bytes are compared with their next (or previous) neighbor
+ * at once and the run boundary is located in the resulting equality mask.
+ * The remaining bytes are compared one by one.
+ */
+
+/* Index of the last byte of the replication run which begins at 'from'.
+   The run does not go past 'end'. */
+static inline unsigned long findRunEnd(const unsigned char * data,
+                                       unsigned long from,
+                                       unsigned long end)
+{
+    unsigned long k = from;
+
+#ifdef __SSE2__
+    while ( k + 16 < end ) {
+        __m128i a = _mm_loadu_si128( ( const __m128i * )( data + k ) );
+        __m128i b = _mm_loadu_si128( ( const __m128i * )( data + k + 1 ) );
+        unsigned int m = ~_mm_movemask_epi8( _mm_cmpeq_epi8( a, b ) ) &
+            0xffff;
+
+        if ( m ) {
+            return k + __builtin_ctz( m );
+        }
+        k += 16;
+    }
+#endif /* __SSE2__ */
+    while ( ( k + 1 < end ) && ( data[ k ] == data[ k + 1 ] ) ) {
+        k++;
+    }
+    return k;
+}
+
+/* Index of the first byte from 'from' which is equal to its next neighbor.
+   Returns 'end' - 1 if there is no such byte before 'end'. */
+static inline unsigned long findLiteralEnd(const unsigned char * data,
+                                           unsigned long from,
+                                           unsigned long end)
+{
+    unsigned long k = from;
+
+#ifdef __SSE2__
+    while ( k + 16 < end ) {
+        __m128i a = _mm_loadu_si128( ( const __m128i * )( data + k ) );
+        __m128i b = _mm_loadu_si128( ( const __m128i * )( data + k + 1 ) );
+        unsigned int m = _mm_movemask_epi8( _mm_cmpeq_epi8( a, b ) );
+
+        if ( m ) {
+            return k + __builtin_ctz( m );
+        }
+        k += 16;
+    }
+#endif /* __SSE2__ */
+    while ( ( k + 1 < end ) && ( data[ k ] != data[ k + 1 ] ) ) {
+        k++;
+    }
+    return k;
+}
+
+/* Index of the first byte of the replication run which ends at 'from'. */
+static inline unsigned long findRunBegin(const unsigned char * data,
+                                         unsigned long from)
+{
+    unsigned long k = from;
+
+#ifdef __SSE2__
+    while ( k >= 16 ) {
+        __m128i a = _mm_loadu_si128( ( const __m128i * )( data + k - 16 ) );
+        __m128i b = _mm_loadu_si128( ( const __m128i * )( data + k - 15 ) );
+        unsigned int m = ~_mm_movemask_epi8( _mm_cmpeq_epi8( a, b ) ) &
+            0xffff;
+
+        if ( m ) {
+            return k - 15 + ( 31 - __builtin_clz( m ) );
+        }
+        k -= 16;
+    }
+#endif /* __SSE2__ */
+    while ( ( k > 0 ) && ( data[ k - 1 ] == data[ k ] ) ) {
+        k--;
+    }
+    return k;
+}
+
+/* Size of the scan-line once the blank bytes on its right end are removed. */
+static inline unsigned long trimBlanks(const unsigned char * data,
+                                       unsigned long end)
+{
+    unsigned long k = end;
+
+#ifdef __SSE2__
+    const __m128i blank = _mm_set1_epi8( ( char )0xff );
+
+    while ( k >= 16 ) {
+        __m128i a = _mm_loadu_si128( ( const __m128i * )( data + k - 16 ) );
+        unsigned int m = ~_mm_movemask_epi8( _mm_cmpeq_epi8( a, blank ) ) &
+            0xffff;
+
+        if ( m ) {
+            return k - 16 + ( 32 - __builtin_clz( m ) );
+        }
+        k -= 16;
+    }
+#endif /* __SSE2__ */
+    while ( ( k > 0 ) && ( 0xff == data[ k - 1 ] ) ) {
+        k--;
+    }
+    return k;
+}
+
+
+
 /* Check if segment at 'e' position and forward can be encoded as 
    consecutive runs. 'L' limits the width of the seek. */
 unsigned long Algo0x0E::verifyGain(unsigned long e, 
@@ -140,14 +257,7 @@ unsigned long Algo0x0E::encodeReplications(unsigned long q,
                                           unsigned long & outputSize)
 {
     unsigned long r;
- runs_enc: r=1;
-    while(q+r<L){
-        if(getData(q+r-1)==getData(q+r)){
-            r++;
-        }else{
-            break;
-        }
-    }
+ runs_enc: r=findRunEnd(data,q,L)-q+1;
     if(r>=2){
         codecR(r,getData(q),0);
         q+=r;
@@ -161,14 +271,7 @@ unsigned long Algo0x0E::locateBackwardReplications(unsigned long L,
 {
     /* This must be signed.*/
     long int i=L-1, r;     
- seek_literal2: r=1;
-    while(i-r>=0){
-        if(data[i-r+1]==data[i-r]){
-            r++;
-        }else{
-            break;
-        }
-    }
+ seek_literal2: r=(i>=0)?i-findRunBegin(data,i)+1:1;
     if(r>1){    
         i=i-r;
         goto seek_literal2;
@@ -177,7 +280,8 @@ unsigned long Algo0x0E::locateBackwardReplications(unsigned long L,
 }
 
 BandPlane * Algo0x0E::compress(const Request & request, unsigned char *data,
-                              unsigned long width, unsigned long height)
+                              unsigned long width, unsigned long height,
+                              Arena & arena)
 {
     /* Basic parameters validation. */
     if ( !data || !height || !width ) {
@@ -203,13 +307,12 @@ BandPlane * Algo0x0E::compress(const Request & request, unsigned char *data,
     const unsigned long workRb = ( rowBytes > maxWorkRb ) ?
         maxWorkRb : rowBytes;
 
-    unsigned char * output = NULL;
+    /* Reserve in the arena a buffer size equal to 2-byte control header
+       overhead + maxWorkRb, times the bitmap height + up to 3-byte padding at
+       end. The data are encoded straight into it. */
+    unsigned char * output = arena.reserve( ( 2 + maxWorkRb ) * height + 3 );
 
-    try {
-        /* Estimate a buffer size equal to 2-byte control header overhead +
-           maxWorkRb, times the bitmap height + up to 3-byte padding at end. */
-        output = new unsigned char[ ( 2 + maxWorkRb ) * height + 3 ];
-    } catch( std::bad_alloc & ){
+    if ( ! output ){
         /* Catch error if buffer creation fails. */
         ERRORMSG(_("Could not allocate work buffer for encoding: 0xe"));
         return NULL;
@@ -218,6 +321,10 @@ BandPlane * Algo0x0E::compress(const Request & request, unsigned char *data,
     /* Keep track of encoded data size. */
     unsigned long outputSize = 0;
 
+    /* Sum of the encoded bytes. Each scan-line is added to it as soon as it
+       has been encoded, while its output is still in the cache. */
+    unsigned long checksum = 0;
+
     /* Main encoding loop for each scan-line.
        Top to bottom scan-line processing. */
     while(true){
@@ -229,11 +336,12 @@ BandPlane * Algo0x0E::compress(const Request & request, unsigned char *data,
         */
         unsigned long i, F, E, B;
 
+        /* Beginning of the encoded scan-line in the output. */
+        const unsigned long lineStart = outputSize;
+
         /* Adjust this working scan-line size
            up to where there is no blank bytes on the right end. */
-	for(E=workRb;(E>0)&&(getData(E-1)==0xff);E--)
-	/* Empty statement. */
-        ;
+        E=trimBlanks(data,workRb);
 
         /* Determine the number of padding blank bytes to the right
            end of the scan-line relative to constant max. width. */ 
@@ -252,8 +360,10 @@ BandPlane * Algo0x0E::compress(const Request & request, unsigned char *data,
         /* l: length of cumulative literal segment.*/
         unsigned long l=0;
         while(i+l+1<F){
-            if(getData(i+l+1)!=getData(i+l)){
-                l++;
+            /* Skip the bytes which differ from their next neighbor. */
+            l=findLiteralEnd(data,i+l,F)-i;
+            if(i+l+1>=F){
+                break;
             }else{
                 if(verifyGain(i+l,F,data)>=2){
                     codecL(i,l,0,1);
@@ -294,6 +404,9 @@ BandPlane * Algo0x0E::compress(const Request & request, unsigned char *data,
             }
         }
 
+        checksum += BandPlane::computeChecksum( & output[ lineStart ],
+                                                outputSize - lineStart );
+
         if( --height>0 ){
             /* Proceed to the next scan-line. */
             data = & data[ rowBytes ];
@@ -313,10 +426,10 @@ BandPlane * Algo0x0E::compress(const Request & request, unsigned char *data,
     }
 
     /* Prepare to return data encoded by algorithm 0xe. */
-    BandPlane * plane = new BandPlane();
+    BandPlane * plane = new ( arena ) BandPlane();
 
     /* Regsiter data and its size. */
-    plane->setData( output, outputSize );
+    plane->setData( arena.trim( output, outputSize ), outputSize, checksum );
     plane->setEndian( BandPlane::Dependant );
 
     /* Set this band encoding type. */
@@ -21,6 +21,7 @@
 #include "algo0x11.h"
 #include <string.h>
 #include <stdlib.h>
+#include "arena.h"
 #include "bandplane.h"
 #include "errlog.h"
 
@@ -37,6 +38,45 @@ int Algo0x11::__compare(const void *n1, const void *n2)
     return *(uint32_t *)n2 - *(uint32_t *)n1;
 }
 
+uint32_t Algo0x11::__prefix(const unsigned char *data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16);
+}
+
+unsigned long Algo0x11::__hash(uint32_t prefix)
+{
+    return (prefix * 2654435761U) >> (32 - MATCH_HASH_BITS);
+}
+
+unsigned long Algo0x11::__matchLength(const unsigned char *data, 
+    const unsigned char *previous, unsigned long max)
+{
+    unsigned long length = 0;
+
+    // Compare 8 bytes at once. The first different byte is given by the
+    // first set bit of the XOR of both words
+    while (length + sizeof(uint64_t) <= max) {
+        uint64_t a, b;
+
+        memcpy(&a, data + length, sizeof(a));
+        memcpy(&b, previous + length, sizeof(b));
+        if (a != b) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return length + (__builtin_ctzll(a ^ b) >> 3);
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            return length + (__builtin_clzll(a ^ b) >> 3);
+#else
+            break;
+#endif /* __BYTE_ORDER__ */
+        }
+        length += sizeof(uint64_t);
+    }
+    while (length < max && data[length] == previous[length])
+        length++;
+
+    return length;
+}
+
 bool Algo0x11::_lookupBestOccurs(const unsigned char* data, unsigned long size)
 {
     uint32_t occurs[COMPRESS_SAMPLE_RATE][2];
@@ -76,20 +116,106 @@ bool Algo0x11::_lookupBestOccurs(const unsigned char* data, unsigned long size)
     return true;
 }
 
+void Algo0x11::_indexPositions(const unsigned char *data, unsigned long r)
+{
+    for (; _indexedNr < r; _indexedNr++) {
+        unsigned long p = _indexedNr, h = __hash(__prefix(data + p));
+
+        _hashChain[p % MATCH_CHAIN_SIZE] = _hashHeads[h];
+        _hashHeads[h] = p;
+        _hashCounts[h]++;
+        // Forget the position which has left the window
+        if (p >= COMPRESS_SAMPLE_RATE)
+            _hashCounts[__hash(__prefix(data + p - COMPRESS_SAMPLE_RATE))]--;
+    }
+}
+
+unsigned long Algo0x11::_findBestPiece(const unsigned char *data, 
+    unsigned long r, unsigned long maxCompSize, unsigned long &bestPtr)
+{
+    uint32_t prefix = __prefix(data + r);
+    unsigned long h = __hash(prefix), bestCompCounter = 0;
+
+    bestPtr = 0;
+    _indexPositions(data, r);
+
+    // Only the previous positions which have the same next bytes can give
+    // a piece large enough. They are listed by the hash chain unless there
+    // are too many of them
+    if (_hashCounts[h] <= TABLE_PTR_SIZE) {
+        for (long p = _hashHeads[h]; p >= 0 && r - p <= COMPRESS_SAMPLE_RATE;
+            p = _hashChain[p % MATCH_CHAIN_SIZE]) {
+            long i = _ptrIndex[r - p];
+            unsigned long counter;
+
+            if (i < 0 || __prefix(data + p) != prefix)
+                continue;
+            counter = __matchLength(data + r, data + p, maxCompSize);
+            // The first pointer of the table wins
+            if (counter > bestCompCounter || (counter == bestCompCounter && 
+                (unsigned long)i < bestPtr)) {
+                bestCompCounter = counter;
+                bestPtr = i;
+            }
+        }
+        return bestCompCounter;
+    }
+
+    // Otherwise check each pointer of the table
+    for (unsigned long i=0; i < TABLE_PTR_SIZE; i++) {
+        unsigned long rTmp, counter;
+
+        if (_ptrArray[i] > r)
+            continue;
+        rTmp = r - _ptrArray[i];
+        if (__prefix(data + rTmp) != prefix)
+            continue;
+        counter = __matchLength(data + r, data + rTmp, maxCompSize);
+        if (counter > bestCompCounter) {
+            bestCompCounter = counter;
+            bestPtr = i;
+            // No other pointer can do better
+            if (counter == maxCompSize)
+                break;
+        }
+    }
+
+    return bestCompCounter;
+}
+
 bool Algo0x11::_compress(const unsigned char *data, unsigned long size, 
-    unsigned char* &output, unsigned long &outputSize)
+    unsigned char* &output, unsigned long &outputSize, unsigned long &checksum,
+    Arena& arena)
 {
     unsigned long r, w=4, uncompSize=0, maxCompSize, bestCompCounter, bestPtr;
     unsigned long rawDataCounter = 0, rawDataCounterPtr=0, maxOutputSize;
     unsigned char *out;
 
-    // Create the output buffer
+    // Reserve the output buffer in the arena
     maxOutputSize = size;
-    out = new unsigned char[maxOutputSize];
+    out = arena.reserve(maxOutputSize);
+    if (!out) {
+        ERRORMSG(_("Cannot allocate the output buffer for compression"));
+        return false;
+    }
+
+    // Prepare the match finder
+    for (unsigned long i=0; i <= COMPRESS_SAMPLE_RATE; i++)
+        _ptrIndex[i] = -1;
+    for (unsigned long i=TABLE_PTR_SIZE; i > 0; i--)
+        _ptrIndex[_ptrArray[i-1]] = i-1;
+    for (unsigned long i=0; i < MATCH_HASH_SIZE; i++) {
+        _hashHeads[i] = -1;
+        _hashCounts[i] = 0;
+    }
+    _indexedNr = 0;
 
     // Print the table
+    // The checksum is kept while the output is written
+    checksum = 0;
     for (unsigned long i=0; i < TABLE_PTR_SIZE; i++, w += 2) {
         *(uint16_t *)(out + w) = (uint16_t)_ptrArray[i];
+        checksum += (_ptrArray[i] & 0xFF) + ((_ptrArray[i] >> 8) & 0xFF);
         if (_ptrArray[i] > uncompSize)
             uncompSize = _ptrArray[i];
     }
@@ -98,8 +224,11 @@ bool Algo0x11::_compress(const unsigned char *data, unsigned long size,
     if (uncompSize > MAX_UNCOMPRESSED_BYTES)
         uncompSize = MAX_UNCOMPRESSED_BYTES;
     *(uint32_t *)out = (uint32_t)uncompSize;
-    for (r=0; r < uncompSize; r++, w++)
+    checksum += (uncompSize & 0xFF) + ((uncompSize >> 8) & 0xFF);
+    for (r=0; r < uncompSize; r++, w++) {
         out[w] = data[r];
+        checksum += data[r];
+    }
 
     //
     // Compress the data
@@ -110,8 +239,10 @@ bool Algo0x11::_compress(const unsigned char *data, unsigned long size,
 
         // End of the compression
         if (!maxCompSize) {
-            if (rawDataCounter)
+            if (rawDataCounter) {
                 out[rawDataCounterPtr] = rawDataCounter - 1;
+                checksum += rawDataCounter - 1;
+            }
             break;
 
         // Try to compress the next piece of data
@@ -125,21 +256,11 @@ bool Algo0x11::_compress(const unsigned char *data, unsigned long size,
                 break;
             }
 
-            // Check the best similar piece of data
-            for (unsigned long i=0; i < TABLE_PTR_SIZE; i++) {
-                unsigned long rTmp, counter;
-               
-                if (_ptrArray[i] > r)
-                    continue;
-                rTmp = r - _ptrArray[i];
-                for (counter = 0; counter < maxCompSize; counter++)
-                    if (data[r + counter] != data[rTmp + counter])
-                        break;
-                if (counter > bestCompCounter) {
-                    bestCompCounter = counter;
-                    bestPtr = i;
-                }
-            }
+            // Check the best similar piece of data. A piece has to be larger
+            // than MIN_COMPRESSED_BYTES to be used
+            if (maxCompSize > MIN_COMPRESSED_BYTES)
+                bestCompCounter = _findBestPiece(data, r, maxCompSize, 
+                    bestPtr);
 
             // If the reproduced piece is large enough, use it!
             if (bestCompCounter > MIN_COMPRESSED_BYTES) {
@@ -147,9 +268,11 @@ bool Algo0x11::_compress(const unsigned char *data, unsigned long size,
                 bestCompCounter -= 3;
                 out[w] = COMPRESSION_FLAG | (bestCompCounter & 0x7F);
                 out[w+1] = ((bestCompCounter >> 1) & 0xC0) | (bestPtr & 0x3F);
+                checksum += out[w] + out[w+1];
                 w += 2;
                 if (rawDataCounter) {
                     out[rawDataCounterPtr] = rawDataCounter - 1;
+                    checksum += rawDataCounter - 1;
                     rawDataCounter = 0;
                 }
                 continue;
@@ -168,9 +291,11 @@ bool Algo0x11::_compress(const unsigned char *data, unsigned long size,
             w++;
         } else if (rawDataCounter == MAX_UNCOMPRESSED_BYTES) {
             out[rawDataCounterPtr] = 0x7F;
+            checksum += 0x7F;
             rawDataCounter = 0;
         }
         out[w] = data[r];
+        checksum += data[r];
         w++;
         r++;
     } while (w < maxOutputSize);
@@ -179,15 +304,13 @@ bool Algo0x11::_compress(const unsigned char *data, unsigned long size,
     if (w >= maxOutputSize) {
         ERRORMSG(_("No more space available in the output buffer for "
             "compression"));
-        delete[] out;
+        arena.release(out);
         return false;
     }
 
-    // Copy the buffer in a best buffer
+    // Give back the unused end of the buffer
     outputSize = w;
-    output = new unsigned char[outputSize];
-    memcpy(output, out, outputSize);
-    delete[] out;
+    output = arena.trim(out, outputSize);
 
     return true;
 }
@@ -214,9 +337,9 @@ Algo0x11::~Algo0x11()
  * Compression routine
  */
 BandPlane* Algo0x11::compress(const Request& request, unsigned char *data, 
-        unsigned long width, unsigned long height)
+        unsigned long width, unsigned long height, Arena& arena)
 {
-    unsigned long outputSize, size = width * height / 8;
+    unsigned long outputSize, checksum, size = width * height / 8;
     unsigned char *output;
     BandPlane *plane;
 
@@ -227,13 +350,13 @@ BandPlane* Algo0x11::compress(const Request& request, unsigned char *data,
 
     // Lookup for the best occurs
     if (!_lookupBestOccurs(data, size) || 
-        !_compress(data, size, output, outputSize)) {
+        !_compress(data, size, output, outputSize, checksum, arena)) {
         return NULL;
     }
 
     // Register the result into a band plane
-    plane = new BandPlane();
-    plane->setData(output, outputSize);
+    plane = new (arena) BandPlane();
+    plane->setData(output, outputSize, checksum);
     plane->setEndian(BandPlane::Dependant);
     plane->setCompression(0x11);
 
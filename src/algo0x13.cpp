@@ -20,6 +20,7 @@
  */
 #include "algo0x13.h"
 #include <string.h>
+#include "arena.h"
 #include "errlog.h"
 #include "request.h"
 #include "printer.h"
@@ -35,19 +36,16 @@ void Algo0x13::_callback(unsigned char *data, size_t len, void *arg)
 {
     info_t* info = (info_t *)arg;
 
-    if (!len)
+    if (!len || info->error)
         return;
 
     // It's the first BIH
     if (!info->last) {
         bandList_t* bandList;
-        unsigned char *tmp;
 
-        tmp = new unsigned char[len];
         bandList = new bandList_t;
-        memcpy(tmp, data, len);
-        bandList->band = new BandPlane();
-        bandList->band->setData(tmp, len);
+        bandList->band = new (*info->arena) BandPlane();
+        bandList->band->setData(info->arena->duplicate(data, len), len);
         bandList->band->setEndian(BandPlane::BigEndian);
         bandList->band->setCompression(0x13);
         bandList->next = NULL;
@@ -69,8 +67,9 @@ void Algo0x13::_callback(unsigned char *data, size_t len, void *arg)
                 bandList_t* bandList;
 
                 bandList = new bandList_t;
-                bandList->band = new BandPlane();
-                bandList->band->setData(info->data, info->size);
+                bandList->band = new (*info->arena) BandPlane();
+                bandList->band->setData(info->arena->trim(info->data,
+                    info->size), info->size, info->checksum);
                 bandList->band->setEndian(BandPlane::BigEndian);
                 bandList->band->setCompression(0x13);
                 bandList->next = NULL;
@@ -78,16 +77,24 @@ void Algo0x13::_callback(unsigned char *data, size_t len, void *arg)
                 info->last = bandList;
                 info->data = NULL;
                 info->size = 0;
+                info->checksum = 0;
             }
 
-            // Allocate a new data buffer if needed
-            if (!info->data)
-                info->data = new unsigned char[info->maxSize];
+            // Reserve a new data buffer in the arena if needed
+            if (!info->data) {
+                info->data = info->arena->reserve(info->maxSize);
+                if (!info->data) {
+                    ERRORMSG(_("Cannot allocate a JBIG packet buffer"));
+                    info->error = true;
+                    return;
+                }
+            }
 
             // Register data
             freeSpace = info->maxSize - info->size;
             toCopy = freeSpace < len ? freeSpace : len;
             memcpy(info->data + info->size, data, toCopy);
+            info->checksum += BandPlane::computeChecksum(data, toCopy);
             info->size += toCopy;
             data += toCopy;
             len -= toCopy;
@@ -109,6 +116,8 @@ Algo0x13::Algo0x13()
 
 Algo0x13::~Algo0x13()
 {
+    // Free the bands which haven't been extracted
+    while (nextPlane());
 }
 
 
@@ -117,52 +126,79 @@ Algo0x13::~Algo0x13()
  * Routine de compression
  * Compression routine
  */
-BandPlane* Algo0x13::compress(const Request& request, unsigned char *data, 
-        unsigned long width, unsigned long height)
+bool Algo0x13::encode(const Request& request, const unsigned char *data, 
+        unsigned long lineWidthInB, unsigned long width, unsigned long linesNr,
+        unsigned long height, Arena& arena)
 {
     jbg85_enc_state state;
-    unsigned long i, wbytes;
-    info_t info = {&_list, NULL, NULL, 0, 0};
-    BandPlane *plane;
-    bandList_t* tmp;
+    info_t info = {&_list, NULL, NULL, 0, 0, 0, &arena, false};
+    unsigned char *blank = NULL, *lines[3];
 
     if (!data || !width || !height) {
         ERRORMSG(_("Invalid given data for compression (0x13)"));
-        return NULL;
+        return false;
     }
 
-    // Compress if it's the first time
-    if (!_compressed) {
-        info.maxSize = request.printer()->packetSize();
-        if (!info.maxSize) {
-            ERRORMSG(_("PacketSize is set to 0!"));
-            info.maxSize = 512*1024;
-        }
-        wbytes = (width + 7) / 8;
-        jbg85_enc_init(&state, width, height, _callback, &info);
-        jbg85_enc_options(&state, JBG_LRLTWO | JBG_TPBON, height, 0);
-        for (i = 0; i < height; i++) {
-            jbg85_enc_lineout(&state,
-                              data + i * wbytes,
-                              data + (i - 1) * wbytes,
-                              data + (i - 2) * wbytes);
-        }
+    info.maxSize = request.printer()->packetSize();
+    if (!info.maxSize) {
+        ERRORMSG(_("PacketSize is set to 0!"));
+        info.maxSize = 512*1024;
+    }
+    if (linesNr < height) {
+        blank = new unsigned char[(width + 7) / 8];
+        memset(blank, 0, (width + 7) / 8);
+    }
+    jbg85_enc_init(&state, width, height, _callback, &info);
+    jbg85_enc_options(&state, JBG_LRLTWO | JBG_TPBON, height, 0);
+
+    // The encoder needs the two previous lines too
+    lines[1] = lines[2] = NULL;
+    for (unsigned long i = 0; i < height; i++) {
+        lines[0] = i < linesNr ? (unsigned char *)data + i * lineWidthInB : 
+            blank;
+        jbg85_enc_lineout(&state, lines[0], lines[1], lines[2]);
+        lines[2] = lines[1];
+        lines[1] = lines[0];
+    }
+
+    if (blank)
+        delete[] blank;
+
+    // Drop the incomplete band list on error
+    if (info.error) {
+        while (_list) {
+            bandList_t* tmp = _list;
 
-        // Register the last band
-        if (info.size) {
-            bandList_t* bandList;
-
-            bandList = new bandList_t;
-            bandList->band = new BandPlane();
-            bandList->band->setData(info.data, info.size);
-            bandList->band->setEndian(BandPlane::BigEndian);
-            bandList->band->setCompression(0x13);
-            bandList->next = NULL;
-            info.last->next = bandList;
+            _list = _list->next;
+            delete tmp;
         }
-        _compressed = true;
+        return false;
     }
 
+    // Register the last band
+    if (info.size) {
+        bandList_t* bandList;
+
+        bandList = new bandList_t;
+        bandList->band = new (arena) BandPlane();
+        bandList->band->setData(arena.trim(info.data, info.size),
+            info.size, info.checksum);
+        bandList->band->setEndian(BandPlane::BigEndian);
+        bandList->band->setCompression(0x13);
+        bandList->next = NULL;
+        info.last->next = bandList;
+    } else
+        arena.release(info.data);
+    _compressed = true;
+
+    return true;
+}
+
+BandPlane* Algo0x13::nextPlane()
+{
+    BandPlane *plane;
+    bandList_t* tmp;
+
     if (!_list)
         return NULL;
     tmp = _list;
@@ -172,6 +208,17 @@ BandPlane* Algo0x13::compress(const Request& request, unsigned char *data,
     return plane;
 }
 
+BandPlane* Algo0x13::compress(const Request& request, unsigned char *data, 
+        unsigned long width, unsigned long height, Arena& arena)
+{
+    // Compress if it's the first time
+    if (!_compressed && !encode(request, data, (width + 7) / 8, width, 
+        height, height, arena))
+        return NULL;
+
+    return nextPlane();
+}
+
 #endif /* DISABLE_JBIG */
 
 /* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
@@ -25,6 +25,7 @@
 #include <string.h>
 #include "errlog.h"
 #include "request.h"
+#include "arena.h"
 #include "printer.h"
 #include "bandplane.h"
 
@@ -34,34 +35,41 @@ extern "C" {
 #include "jbig85.h"
 }
 
+/*
+ * Taille maximale d'un paquet
+ * Maximum packet size
+ */
+#define MAX_SIZE 512 * 1024
+
 /*
  * Fonction de rappel
  * Callback
  */
 void Algo0x15::_callback(unsigned char *data, size_t data_len, void *arg)
 {
-    Algo0x15 *compressor = (Algo0x15 *)arg;
+    output_t *output = (output_t *)arg;
     if (!data_len) {
-        compressor->_error = true;
+        output->error = true;
         return;
     }
-    if ((!compressor->_has_bih) && (0 == compressor->_size)) {
+    if ((!output->hasBIH) && (0 == output->size)) {
         if (20 != data_len) {
             ERRORMSG(_("Expected 20 bytes from BIH (0x15)"));
-            compressor->_error = true;
+            output->error = true;
             return;
         }
-        memcpy(compressor->_bih, data, 20);
-        compressor->_has_bih = true;
+        memcpy(output->bih, data, 20);
+        output->hasBIH = true;
     } else {  
-        unsigned long freeSpace = compressor->_maxSize - compressor->_size;
+        unsigned long freeSpace = output->maxSize - output->size;
         if (data_len > freeSpace) {
             ERRORMSG(_("Insufficient buffer space to store BIE (0x15)"));
-            compressor->_error = true;
+            output->error = true;
             return;
         }
-        memcpy(compressor->_data + compressor->_size, data, data_len);
-        compressor->_size += data_len;
+        memcpy(output->data + output->size, data, data_len);
+        output->checksum += BandPlane::computeChecksum(data, data_len);
+        output->size += data_len;
     }
 }
 
@@ -71,17 +79,22 @@ void Algo0x15::_callback(unsigned char *data, size_t data_len, void *arg)
  */
 Algo0x15::Algo0x15()
 {
-    _has_bih = false;
-    _data = NULL;
-    _size = 0;
+    memset(_bih, 0, sizeof(_bih));
     _maxSize = 0;
-    _error = false;
 }
 
 Algo0x15::~Algo0x15()
 {
-    if (_data)
-        delete [] _data;
+}
+
+void Algo0x15::loadPacketSize(const Request& request)
+{
+    _maxSize = request.printer()->packetSize();
+    if ((!_maxSize) || (_maxSize > MAX_SIZE)) {
+        ERRORMSG(_("PacketSize is set to %luBytes! Reset to %dBytes."),
+                                                   _maxSize, MAX_SIZE);
+        _maxSize = MAX_SIZE;
+    }
 }
 
 /*
@@ -93,10 +106,10 @@ Algo0x15::~Algo0x15()
  * Assumes compressed band data fits in the space specified
  * in the printer PPD file: QPDL PacketSize: "512", specifies 512 Kbytes limit.
  */
-BandPlane* Algo0x15::compress(const Request& request, unsigned char *data, 
-        unsigned long width, unsigned long height)
+BandPlane* Algo0x15::encode(const unsigned char *data, unsigned long width, 
+        unsigned long height, Arena& arena, unsigned char *bih) const
 {
-    #define MAX_SIZE 512 * 1024
+    output_t output = {false, false, bih, NULL, 0, 0, _maxSize};
     BandPlane *plane; 
     jbg85_enc_state state;
     unsigned long wbytes;
@@ -104,48 +117,46 @@ BandPlane* Algo0x15::compress(const Request& request, unsigned char *data,
         ERRORMSG(_("Invalid given data for compression (0x15)"));
         return NULL;
     }
-    if (_has_bih)
-        _has_bih = false;
-    if (_size)
-        _size = 0;
-    if (_error)
-        _error = false;
-    if (0 == _maxSize)
-        _maxSize = request.printer()->packetSize();
-    if ((!_maxSize) || (_maxSize > MAX_SIZE)) {
-        ERRORMSG(_("PacketSize is set to %luBytes! Reset to %dBytes."),
-                                                   _maxSize, MAX_SIZE);
-        _maxSize = MAX_SIZE;
+    /* Encode straight into the arena. Only the pages really written of the
+       reserved packet are used until it is trimmed. */
+    output.data = arena.reserve(output.maxSize);
+    if (!output.data) {
+        ERRORMSG(_("Cannot allocate the output buffer (0x15)"));
+        return NULL;
     }
-    if (NULL == _data)
-        _data = new unsigned char[_maxSize];
     wbytes = (width + 7) / 8;
-    jbg85_enc_init(&state, width, height, _callback, this);
+    jbg85_enc_init(&state, width, height, _callback, &output);
     jbg85_enc_options(&state, JBG_LRLTWO, height, 0);
     for (unsigned long i = 0; i < height; i++) {
         jbg85_enc_lineout(&state,
-                          data + i * wbytes,
-                          data + (i - 1) * wbytes,
-                          data + (i - 2) * wbytes);
+                          (unsigned char *)data + i * wbytes,
+                          i > 0 ? (unsigned char *)data + (i - 1) * wbytes : 
+                              NULL,
+                          i > 1 ? (unsigned char *)data + (i - 2) * wbytes : 
+                              NULL);
     }
-    if (_error)
+    if (output.error) {
+        arena.release(output.data);
         return NULL;
-    unsigned char *final_data = new unsigned char[_size];
-    memcpy(final_data, _data, _size);
-    plane = new BandPlane();
+    }
+    plane = new (arena) BandPlane();
     plane->setCompression(0x15);
     plane->setEndian(BandPlane::BigEndian);
-    plane->setData(final_data, _size);
+    plane->setData(arena.trim(output.data, output.size), output.size,
+        output.checksum);
     /* Finished encoding of this band. */
-    DEBUGMSG(_("Band encoded with type=0x15, size=%lu"), _size);
-    /* Clean up. */
-    _has_bih = false;
-    _size = 0;
-    if (_error)
-        _error = false;
+    DEBUGMSG(_("Band encoded with type=0x15, size=%lu"), output.size);
     return plane;
 }
 
+BandPlane* Algo0x15::compress(const Request& request, unsigned char *data, 
+        unsigned long width, unsigned long height, Arena& arena)
+{
+    if (0 == _maxSize)
+        loadPacketSize(request);
+    return encode(data, width, height, arena, _bih);
+}
+
 #endif /* DISABLE_JBIG */
 
 /* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
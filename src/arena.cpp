@@ -0,0 +1,195 @@
+/*
+ * 	    arena.cpp                 (C) 2008, Aurélien Croc (AP²C)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the
+ *  Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ *  $Id$
+ * 
+ */
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Taille d'un bloc et alignement des allocations
+ * Chunk size and allocation alignment
+ */
+#define CHUNK_SIZE              (64 * 1024)
+#define ALIGNMENT               16
+
+/*
+ * Constructeur - Destructeur
+ * Init - Uninit
+ */
+Arena::Arena()
+{
+    _current = NULL;
+    _large = NULL;
+    _reserved = NULL;
+    _size = 0;
+}
+
+Arena::~Arena()
+{
+    _freeChunks(_current);
+    _freeChunks(_large);
+    while (_reserved) {
+        chunk_t *next = _reserved->next;
+
+        free(_reserved);
+        _reserved = next;
+    }
+}
+
+
+
+/*
+ * Gestion des blocs
+ * Chunks management
+ */
+Arena::chunk_t* Arena::_newChunk(unsigned long size)
+{
+    chunk_t *chunk = new chunk_t;
+
+    chunk->data = new unsigned char[size];
+    chunk->used = 0;
+    chunk->size = size;
+    chunk->next = NULL;
+
+    return chunk;
+}
+
+void Arena::_freeChunks(chunk_t* chunk)
+{
+    while (chunk) {
+        chunk_t *next = chunk->next;
+
+        delete[] chunk->data;
+        delete chunk;
+        chunk = next;
+    }
+}
+
+
+
+/*
+ * Allocation
+ * Allocation
+ */
+void* Arena::allocate(unsigned long size)
+{
+    unsigned char *ptr;
+    chunk_t *chunk;
+
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+#ifndef DISABLE_THREADS
+    _lock.lock();
+#endif /* DISABLE_THREADS */
+
+    // Large buffers get their own chunk to not waste the current one
+    if (size > CHUNK_SIZE / 4) {
+        chunk = _newChunk(size);
+        chunk->next = _large;
+        _large = chunk;
+        _size += size;
+
+    // Otherwise take the memory at the end of the current chunk
+    } else {
+        if (!_current || _current->used + size > _current->size) {
+            chunk = _newChunk(CHUNK_SIZE);
+            chunk->next = _current;
+            _current = chunk;
+            _size += CHUNK_SIZE;
+        }
+        chunk = _current;
+    }
+    ptr = chunk->data + chunk->used;
+    chunk->used += size;
+
+#ifndef DISABLE_THREADS
+    _lock.unlock();
+#endif /* DISABLE_THREADS */
+    return ptr;
+}
+
+unsigned char* Arena::duplicate(const unsigned char* data, unsigned long size)
+{
+    unsigned char *copy = (unsigned char *)allocate(size);
+
+    memcpy(copy, data, size);
+    return copy;
+}
+
+
+
+/*
+ * Blocs réservés
+ * Reserved blocks
+ */
+/*
+ * A reserved block is allocated with its chunk header in front of the data so
+ * that realloc() can shrink both at once. It is linked to the arena only once
+ * it has been trimmed, as realloc() may move it.
+ */
+unsigned char* Arena::reserve(unsigned long maxSize)
+{
+    chunk_t *chunk;
+
+    chunk = (chunk_t *)malloc(sizeof(chunk_t) + maxSize);
+    if (!chunk)
+        return NULL;
+    chunk->data = (unsigned char *)(chunk + 1);
+    chunk->used = 0;
+    chunk->size = maxSize;
+    chunk->next = NULL;
+
+    return chunk->data;
+}
+
+unsigned char* Arena::trim(unsigned char* data, unsigned long size)
+{
+    chunk_t *chunk = (chunk_t *)data - 1, *tmp;
+
+    if (size < chunk->size) {
+        tmp = (chunk_t *)realloc(chunk, sizeof(chunk_t) + size);
+        if (tmp) {
+            chunk = tmp;
+            chunk->data = (unsigned char *)(chunk + 1);
+            chunk->size = size;
+        }
+    }
+    chunk->used = size;
+
+#ifndef DISABLE_THREADS
+    _lock.lock();
+#endif /* DISABLE_THREADS */
+    chunk->next = _reserved;
+    _reserved = chunk;
+    _size += sizeof(chunk_t) + chunk->size;
+#ifndef DISABLE_THREADS
+    _lock.unlock();
+#endif /* DISABLE_THREADS */
+
+    return chunk->data;
+}
+
+void Arena::release(unsigned char* data)
+{
+    if (data)
+        free((chunk_t *)data - 1);
+}
+
+/* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
+
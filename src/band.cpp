@@ -19,7 +19,8 @@
  * 
  */
 #include "band.h"
-#include <unistd.h>
+#include "arena.h"
+#include "spill.h"
 #include "errlog.h"
 #include "bandplane.h"
 
@@ -55,12 +56,9 @@ Band::Band(unsigned long nr, unsigned long width, unsigned long height)
     _height = height;
 }
 
-Band::~Band()
+void* Band::operator new(size_t size, Arena& arena)
 {
-    for (unsigned int i=0; i < _colors; i++)
-        delete _planes[i];
-    if (_sibling)
-        delete _sibling;
+    return arena.allocate(size);
 }
 
 
@@ -69,34 +67,33 @@ Band::~Band()
  * Mise sur disque / Rechargement
  * Swapping / restoring
  */
-bool Band::swapToDisk(int fd)
+bool Band::swapToDisk(SpillWriter& writer)
 {
-    write(fd, &_bandNr, sizeof(_bandNr));
-    write(fd, &_colors, sizeof(_colors));
-    write(fd, &_width, sizeof(_width));
-    write(fd, &_height, sizeof(_height));
+    writer.copy(&_bandNr, sizeof(_bandNr));
+    writer.copy(&_colors, sizeof(_colors));
+    writer.copy(&_width, sizeof(_width));
+    writer.copy(&_height, sizeof(_height));
     for (unsigned int i=0; i < _colors; i++)
-        if (!_planes[i]->swapToDisk(fd))
+        if (!_planes[i]->swapToDisk(writer))
             return false;
     return true;
 }
 
-Band* Band::restoreIntoMemory(int fd)
+Band* Band::restoreIntoMemory(SpillReader& reader, Arena& arena)
 {
     unsigned char colors;
     Band* band;
 
-    band = new Band();
-    read(fd, &band->_bandNr, sizeof(band->_bandNr));
-    read(fd, &colors, sizeof(colors));
-    read(fd, &band->_width, sizeof(band->_width));
-    read(fd, &band->_height, sizeof(band->_height));
+    band = new (arena) Band();
+    if (!reader.read(&band->_bandNr, sizeof(band->_bandNr)) ||
+        !reader.read(&colors, sizeof(colors)) ||
+        !reader.read(&band->_width, sizeof(band->_width)) ||
+        !reader.read(&band->_height, sizeof(band->_height)))
+        return NULL;
     for (unsigned int i=0; i < colors; i++) {
-        BandPlane *plane = BandPlane::restoreIntoMemory(fd);
-        if (!plane) {
-            delete band;
+        BandPlane *plane = BandPlane::restoreIntoMemory(reader, arena);
+        if (!plane)
             return NULL;
-        }
         band->registerPlane(plane);
     }
 
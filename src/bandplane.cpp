@@ -19,7 +19,12 @@
  * 
  */
 #include "bandplane.h"
-#include <unistd.h>
+#include <stdlib.h>
+#include "arena.h"
+#include "spill.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
 
 /*
  * Constructeur - Destructeur
@@ -32,29 +37,70 @@ BandPlane::BandPlane()
     _data = NULL;
 }
 
-BandPlane::~BandPlane()
+void* BandPlane::operator new(size_t size, Arena& arena)
 {
-    if (_data)
-        delete[] _data;
+    return arena.allocate(size);
 }
 
 
+
 /*
  * Enregistrement des données
  * Set data
  */
-void BandPlane::setData(unsigned char *data, unsigned long size)
+void BandPlane::setData(const unsigned char *data, unsigned long size)
 {
     if (!data)
         size = 0;
-    if (_data)
-        delete[] _data;
 
     _data = data;
     _size = size;
-    _checksum = 0;
-    for (unsigned int i=0; i < _size; i++)
-        _checksum += (unsigned char)_data[i];
+    _checksum = computeChecksum(data, size);
+}
+
+void BandPlane::setData(const unsigned char *data, unsigned long size, 
+    unsigned long checksum)
+{
+    if (!data) {
+        size = 0;
+        checksum = 0;
+    }
+
+    _data = data;
+    _size = size;
+    _checksum = checksum;
+}
+
+
+
+/*
+ * Somme de contrôle
+ * Checksum
+ */
+unsigned long BandPlane::computeChecksum(const unsigned char *data, 
+    unsigned long size)
+{
+    unsigned long checksum = 0, i = 0;
+
+#ifdef __SSE2__
+    // PSADBW against zero sums 8 bytes into each 64 bits lane
+    __m128i zero = _mm_setzero_si128(), sum0 = zero, sum1 = zero;
+    unsigned long long lanes[2];
+
+    for (; i + 32 <= size; i += 32) {
+        sum0 = _mm_add_epi64(sum0, _mm_sad_epu8(_mm_loadu_si128(
+            (const __m128i *)(data + i)), zero));
+        sum1 = _mm_add_epi64(sum1, _mm_sad_epu8(_mm_loadu_si128(
+            (const __m128i *)(data + i + 16)), zero));
+    }
+    sum0 = _mm_add_epi64(sum0, sum1);
+    _mm_storeu_si128((__m128i *)lanes, sum0);
+    checksum = (unsigned long)(lanes[0] + lanes[1]);
+#endif /* __SSE2__ */
+    for (; i < size; i++)
+        checksum += data[i];
+
+    return checksum;
 }
 
 
@@ -63,31 +109,29 @@ void BandPlane::setData(unsigned char *data, unsigned long size)
  * Mise sur disque / Rechargement
  * Swapping / restoring
  */
-bool BandPlane::swapToDisk(int fd)
+bool BandPlane::swapToDisk(SpillWriter& writer)
 {
-    write(fd, &_colorNr, sizeof(_colorNr));
-    write(fd, &_size, sizeof(_size));
-    write(fd, _data, _size);
-    write(fd, &_checksum, sizeof(_checksum));
-    write(fd, &_endian, sizeof(_endian));
-    write(fd, &_compression, sizeof(_compression));
+    writer.copy(&_colorNr, sizeof(_colorNr));
+    writer.copy(&_size, sizeof(_size));
+    writer.reference(_data, _size);
+    writer.copy(&_checksum, sizeof(_checksum));
+    writer.copy(&_endian, sizeof(_endian));
+    writer.copy(&_compression, sizeof(_compression));
     return true;
 }
 
-BandPlane* BandPlane::restoreIntoMemory(int fd)
+BandPlane* BandPlane::restoreIntoMemory(SpillReader& reader, Arena& arena)
 {
-    unsigned char* data;
     BandPlane* plane;
 
-    plane = new BandPlane();
-    read(fd, &plane->_colorNr, sizeof(plane->_colorNr));
-    read(fd, &plane->_size, sizeof(plane->_size));
-    data = new unsigned char[plane->_size];
-    read(fd, data, plane->_size);
-    plane->_data = data;
-    read(fd, &plane->_checksum, sizeof(plane->_checksum));
-    read(fd, &plane->_endian, sizeof(plane->_endian));
-    read(fd, &plane->_compression, sizeof(plane->_compression));
+    plane = new (arena) BandPlane();
+    if (!reader.read(&plane->_colorNr, sizeof(plane->_colorNr)) ||
+        !reader.read(&plane->_size, sizeof(plane->_size)) ||
+        !(plane->_data = reader.map(plane->_size)) ||
+        !reader.read(&plane->_checksum, sizeof(plane->_checksum)) ||
+        !reader.read(&plane->_endian, sizeof(plane->_endian)) ||
+        !reader.read(&plane->_compression, sizeof(plane->_compression)))
+        return NULL;
 
     return plane;
 }
@@ -22,298 +22,293 @@
 #include "cache.h"
 #include <fcntl.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include "page.h"
+#include "spill.h"
 #include "errlog.h"
-#include "semaphore.h"
+#include "request.h"
+
+/*
+ * Tampon de réordonnancement
+ * Reorder buffer
+ *
+ * Each page has a slot indexed by its number. A slot contains the address of
+ * its cache entry, tagged with SWAPPED_TAG if the page is swapped on the
+ * disk or with STREAMING_TAG if its bands are still compressed, and the
+ * memory size of the page. Slots are only modified with atomic
+ * operations: a producer publishes a page by filling its slot and a thread
+ * takes a page by emptying it. Slots are allocated by chunks which are never
+ * moved.
+ */
+#define SLOTS_BY_CHUNK          256
+#define MAX_CHUNKS              4096
+#define SWAPPED_TAG             1UL
+#define STREAMING_TAG           2UL
+#define TAGS                    (SWAPPED_TAG | STREAMING_TAG)
+
+/*
+ * Nombre de pages examinées par le thread de préchargement
+ * Number of pages examined by the prefetch thread
+ */
+#define PREFETCH_PAGES          8
+
+typedef struct {
+    volatile unsigned long      value;
+    volatile unsigned long      size;
+} slot_t;
 
 /*
  * Variables internes
  * Internal variables
  */
-// Cache controller thread variables
-static CachePolicy _policy = EveryPagesIncreasing;
-static bool _stopCacheControllerThread = false;
-static pthread_t _cacheThread;
-static Semaphore _work(0);
+// Cache policy
+static volatile CachePolicy _policy = EveryPagesIncreasing;
 
 // Page request variables
-static unsigned long _lastPageRequested = 0, _pageRequested = 0;
-static Semaphore _pageAvailable(0);
+static volatile unsigned long _lastPageRequested = 0;
+static volatile unsigned long _pageRequested = 0;
+static pthread_mutex_t _waitLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _waitCond = PTHREAD_COND_INITIALIZER;
 
 // Document information
 static unsigned long _numberOfPages = 0;
+static bool _numberOfPagesKnown = false;
+static bool _lostPages = false;
+
+// Reorder buffer variables
+static slot_t* volatile _chunks[MAX_CHUNKS];
+static volatile unsigned long _maxPageNr = 0;
 
-// Cache variables
-static CacheEntry *_waitingList=NULL, *_lastWaitingList=NULL;
-static Semaphore _waitingListLock;
-static unsigned long _maxPagesInTable = 0, _pagesInTable = 0;
-static CacheEntry **_pages = NULL;
-static Semaphore _pageTableLock;
+// Memory budget variables
+static unsigned long _memoryBudget = 0;
+static volatile unsigned long _memoryUsed = 0;
 
-// Cache in memory variables
-static CacheEntry *_inMemory = NULL, *_inMemoryLast = NULL;
-static unsigned long _pagesInMemory = 0;
+// Swap file variables
+static int _swapFile = -1;
+static volatile off_t _swapFileEnd = 0;
+static pthread_mutex_t _swapFileLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Prefetch thread variables
+static pthread_t _prefetchThread;
+static bool _stopPrefetchThread = false;
+static unsigned long _prefetchRequests = 0;
+static pthread_mutex_t _prefetchLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _prefetchCond = PTHREAD_COND_INITIALIZER;
 
 
 
 /*
- * Contrôleur de cache (thread)
- * Cache controller (thread)
+ * Gestion des emplacements
+ * Slot management
  */
-static void __registerIntoCacheList(CacheEntry *entry, bool swapLast)
+static slot_t* __slot(unsigned long nr, bool create)
 {
-    unsigned long pageNr;
-    CacheEntry *tmp=NULL;
-
-    if (!_inMemory) {
-        entry->setNext(NULL);
-        entry->setPrevious(NULL);
-        _inMemory = entry;
-        _inMemoryLast = entry;
-        _pagesInMemory = 1;
-        return;
-    }
+    unsigned long index = (nr - 1) / SLOTS_BY_CHUNK;
+    slot_t *chunk;
 
-    // Locate the previous cache entry
-    pageNr = entry->page()->pageNr();
-    switch (_policy) {
-        case OddIncreasing:
-        case EveryPagesIncreasing:
-            tmp = _inMemoryLast;
-            while (tmp && tmp->page()->pageNr() > pageNr)
-                tmp = tmp->previous();
-            break;
-        case EvenDecreasing:
-            if (pageNr % 2) {
-                // Odd page
-                tmp = _inMemoryLast;
-                while (tmp) {
-                    if (!(tmp->page()->pageNr() % 2) || tmp->page()->pageNr() < 
-                        pageNr)
-                        break;
-                    tmp = tmp->previous();
-                }
-
-            } else {
-                // Even page
-                tmp = _inMemory;
-                while (tmp && !(tmp->page()->pageNr() % 2)) {
-                    if (tmp->page()->pageNr() < pageNr)
-                        break;
-                    tmp = tmp->next();
-                }
-                tmp = tmp ? tmp->previous() : _inMemoryLast;
-            }
-            break;
+    if (!nr || index >= MAX_CHUNKS)
+        return NULL;
+    chunk = _chunks[index];
+    if (!chunk && create) {
+        chunk = new slot_t[SLOTS_BY_CHUNK];
+        memset(chunk, 0, SLOTS_BY_CHUNK * sizeof(slot_t));
+        if (!__sync_bool_compare_and_swap(&_chunks[index], NULL, chunk)) {
+            delete[] chunk;
+            chunk = _chunks[index];
+        }
     }
+    return chunk ? &chunk[(nr - 1) % SLOTS_BY_CHUNK] : NULL;
+}
 
-    // Register the new entry
-    if (swapLast && tmp == _inMemoryLast) {
-        entry->swapToDisk();
-        swapLast = false;
-    } else {
-        if  (!tmp) {
-            entry->setPrevious(NULL);
-            entry->setNext(_inMemory);
-            _inMemory->setPrevious(entry);
-            _inMemory = entry;
-        } else {
-            entry->setPrevious(tmp);
-            entry->setNext(tmp->next());
-            if (tmp->next())
-                tmp->next()->setPrevious(entry);
-            else
-                _inMemoryLast = entry;
-            tmp->setNext(entry);
-        }
-        if (!swapLast)
-            _pagesInMemory++;
+static unsigned long __takeSlot(slot_t *slot)
+{
+    unsigned long value;
+
+    do {
+        value = slot->value;
+    } while (value && !__sync_bool_compare_and_swap(&slot->value, value, 0));
+
+    return value;
+}
+
+static void __publishSlot(unsigned long nr, slot_t *slot, unsigned long value)
+{
+    __sync_bool_compare_and_swap(&slot->value, 0, value);
+
+    // Wake up the main thread if it is waiting for this page
+    if (_pageRequested == nr) {
+        pthread_mutex_lock(&_waitLock);
+        pthread_cond_broadcast(&_waitCond);
+        pthread_mutex_unlock(&_waitLock);
     }
+}
 
-    // Swap to disk the last entry if needed
-    if (swapLast) {
-        tmp = _inMemoryLast;
-        _inMemoryLast = tmp->previous();
-        tmp->previous()->setNext(NULL);
-        tmp->swapToDisk();
+static unsigned long __pageAfter(unsigned long nr, CachePolicy& policy)
+{
+    switch (policy) {
+        case EveryPagesIncreasing:
+            return nr + 1;
+        case EvenDecreasing:
+            if (nr > 2)
+                return nr - 2;
+            policy = OddIncreasing;
+            return 1;
+        case OddIncreasing:
+            return nr ? nr + 2 : 1;
     }
+    return 0;
 }
 
-static void __manageMemoryCache(CacheEntry *entry)
+static unsigned long __distance(unsigned long nr)
 {
-    _pageTableLock.lock();
+    unsigned long evenNr;
+
+    switch (_policy) {
+        case EveryPagesIncreasing:
+            return nr > _lastPageRequested ? nr - _lastPageRequested : 1;
+        case OddIncreasing:
+            return nr > _lastPageRequested ? 
+                (nr - _lastPageRequested + 1) / 2 : 1;
+        case EvenDecreasing:
+            break;
+    }
 
-    // Append an entry
-    if (entry) {
-        __registerIntoCacheList(entry, _pagesInMemory >= CACHESIZE);
+    // Manual duplex: even pages decreasing then odd pages increasing
+    evenNr = (_numberOfPagesKnown ? _numberOfPages : _maxPageNr) & ~0x1;
+    if (!(nr % 2))
+        return nr < evenNr ? (evenNr - nr) / 2 + 1 : 1;
+    return evenNr / 2 + (nr + 1) / 2;
+}
 
-    // Preload the best page
-    } else {
-        unsigned int nr;
 
-        if (_inMemoryLast)
-            nr = _inMemoryLast->page()->pageNr();
-        else
-            nr = _lastPageRequested;
 
-        switch (_policy) {
-            case EveryPagesIncreasing:
-                nr++;
-                break;
-            case OddIncreasing:
-                if (nr % 2)
-                    nr += 2;
-                else if (nr > 2)
-                    nr -= 2;
-                else
-                    nr = 1;
-                break;
-            case EvenDecreasing:
-                if (nr == 2)
-                    nr = 1;
-                else
-                    nr -= 2;
+/*
+ * Gestion de la mémoire du cache
+ * Cache memory management
+ *
+ * When the memory budget is exceeded, the page with the highest product of
+ * its size by its distance in the rendering order is swapped on the disk. So
+ * large pages and pages needed late are swapped first whereas small pages
+ * which will be sent soon are kept.
+ */
+static unsigned long __swapPages(unsigned long nr, unsigned long value,
+    unsigned long size)
+{
+    while (_memoryUsed > _memoryBudget && !(value & SWAPPED_TAG)) {
+        unsigned long long score, bestScore;
+        unsigned long bestNr = nr, bestValue = value, bestSize = size;
+        slot_t *bestSlot = NULL;
+        CacheEntry *entry;
+
+        // Look for the page to swap
+        bestScore = (unsigned long long)size * __distance(nr);
+        for (unsigned long i=1; i <= _maxPageNr; i++) {
+            slot_t *slot = __slot(i, false);
+            unsigned long current;
+
+            if (!slot || !(current = slot->value) || (current & TAGS) || 
+                i == _pageRequested)
+                continue;
+            score = (unsigned long long)slot->size * __distance(i);
+            if (score > bestScore) {
+                bestScore = score;
+                bestNr = i;
+                bestValue = current;
+                bestSize = slot->size;
+                bestSlot = slot;
+            }
+        }
+
+        // Swap the new page
+        if (!bestSlot) {
+            if (!((CacheEntry *)value)->swapToDisk())
                 break;
+            __sync_sub_and_fetch(&_memoryUsed, size);
+            value |= SWAPPED_TAG;
+            break;
         }
-        if (nr <= _maxPagesInTable && _pages[nr-1]) {
-            if (_pages[nr-1]->isSwapped())
-                _pages[nr-1]->restoreIntoMemory();
-            _pages[nr-1]->setNext(NULL);
-            _pages[nr-1]->setPrevious(_inMemoryLast);
-            if (_inMemoryLast) {
-                _inMemoryLast->setNext(_pages[nr-1]);
-                _inMemoryLast = _pages[nr-1];
-            } else {
-                _inMemory = _pages[nr-1];
-                _inMemoryLast = _pages[nr-1];
-            }
-            _pagesInMemory++;
-            if (nr == _pageRequested)
-                _pageAvailable++;
+
+        // Swap the chosen page if it has not been taken meanwhile
+        if (!__sync_bool_compare_and_swap(&bestSlot->value, bestValue, 0))
+            continue;
+        entry = (CacheEntry *)bestValue;
+        if (entry->swapToDisk()) {
+            __sync_sub_and_fetch(&_memoryUsed, bestSize);
+            __publishSlot(bestNr, bestSlot, bestValue | SWAPPED_TAG);
+        } else {
+            __publishSlot(bestNr, bestSlot, bestValue);
+            break;
         }
     }
-    _pageTableLock.unlock();
+
+    return value;
 }
 
-static void* _cacheControllerThread(void *_exitVar)
-{
-    bool *needToExit = (bool *)_exitVar;
-    bool whatToDo = true;
 
-    DEBUGMSG(_("Cache controller thread loaded and is waiting for a job"));
-    while (!(*needToExit)) {
-        bool preloadPage = false;
 
-        // Waiting for a job
-        _work--;
+/*
+ * Préchargement des pages (thread)
+ * Page prefetching (thread)
+ */
+static void __wakePrefetchThread()
+{
+    pthread_mutex_lock(&_prefetchLock);
+    _prefetchRequests++;
+    pthread_cond_signal(&_prefetchCond);
+    pthread_mutex_unlock(&_prefetchLock);
+}
 
-#ifdef DUMP_CACHE
-        if (_pagesInMemory) {
-            CacheEntry *tmp = _inMemory;
+static void __prefetchPages()
+{
+    CachePolicy policy = _policy;
+    unsigned long nr = _lastPageRequested;
 
-            fprintf(stderr, _("DEBUG: [34mCache dump: "));
-            for (unsigned int i=0; i < _pagesInMemory && tmp; i++) {
-                fprintf(stderr, "%lu ", tmp->page()->pageNr());
-                tmp = tmp->next();
-            }
-            fprintf(stderr, "[0m\n");
-        } else
-            fprintf(stderr, _("DEBUG: [34mCache empty[0m\n"));
-#endif /* DUMP_CACHE */
+    for (unsigned int i=0; i < PREFETCH_PAGES; i++) {
+        unsigned long value;
+        CacheEntry *entry;
+        slot_t *slot;
 
-        // Does the thread needs to exit?
-        if (*needToExit)
+        nr = __pageAfter(nr, policy);
+        if (!nr || (_numberOfPagesKnown && nr > _numberOfPages))
             break;
-
-
-        /*
-         * Check what action to do
-         */
-        // Nothing?
-        if (!_waitingList && (_pagesInMemory == CACHESIZE || 
-            _pagesInMemory == _pagesInTable))
+        if (!(slot = __slot(nr, false)) || !((value = slot->value) & 
+            SWAPPED_TAG))
             continue;
-        // new page to append and pages to preload?
-        // Choose one action of them to do (and inverse the action to do at 
-        // each loop)
-        if (_waitingList && !(_pagesInMemory == CACHESIZE || 
-            _pagesInMemory == _pagesInTable)) {
-            preloadPage = whatToDo;
-            whatToDo = !whatToDo;
-        // One of the two thing to do
-        } else
-            preloadPage = (_waitingList == NULL);
 
-        /*
-         * Preload a page
-         */
-        if (preloadPage) {
-            __manageMemoryCache(NULL);
+        // Only the next page may exceed the memory budget
+        if (i && _memoryUsed + slot->size > _memoryBudget)
+            break;
+        if (!__sync_bool_compare_and_swap(&slot->value, value, 0))
+            continue;
+        entry = (CacheEntry *)(value & ~SWAPPED_TAG);
+        if (entry->restoreIntoMemory()) {
+            __sync_add_and_fetch(&_memoryUsed, slot->size);
+            value &= ~SWAPPED_TAG;
+        }
+        __publishSlot(nr, slot, value);
+    }
+}
 
-        /*
-         * Store a page
-         */
-        } else {
-            CacheEntry *entry;
-
-            // Get the cache entry to store
-            {
-                _waitingListLock.lock();
-                entry = _waitingList;
-                _waitingList = entry->next();
-                if (_lastWaitingList == entry)
-                    _lastWaitingList = NULL;
-                _waitingListLock.unlock();
-            }
+static void* _prefetchThreadMain(void *data)
+{
+    DEBUGMSG(_("Prefetch thread loaded and is waiting for a job"));
+    while (true) {
+        pthread_mutex_lock(&_prefetchLock);
+        while (!_prefetchRequests && !_stopPrefetchThread)
+            pthread_cond_wait(&_prefetchCond, &_prefetchLock);
+        _prefetchRequests = 0;
+        pthread_mutex_unlock(&_prefetchLock);
+        if (_stopPrefetchThread)
+            break;
 
-            // Store the entry in the page table
-            {
-                _pageTableLock.lock();
-
-                // Resize the page table if needed
-                while (entry->page()->pageNr() > _maxPagesInTable) {
-                    if (!_maxPagesInTable) {
-                        _maxPagesInTable = CACHESIZE;
-                        _pages = new CacheEntry*[_maxPagesInTable];
-                        memset(_pages, 0, _maxPagesInTable * 
-                            sizeof(CacheEntry*));
-                    } else {
-                        CacheEntry** tmp = new CacheEntry*[_maxPagesInTable*10];
-                        memcpy(tmp, _pages, _maxPagesInTable *
-                            sizeof(CacheEntry*));
-                        memset(tmp + _maxPagesInTable, 0, _maxPagesInTable * 9 *
-                            sizeof(CacheEntry*));
-                        delete[] _pages;
-                        _pages = tmp;
-                        _maxPagesInTable *= 10;
-                    }
-                }
-
-                // Store the page in the table
-                _pages[entry->page()->pageNr() - 1] = entry;
-                _pageTableLock.unlock();
-            }
-            _pagesInTable++;
-
-            // Does the main thread needs this page?
-            if (_pageRequested == entry->page()->pageNr()) {
-                _pageTableLock.lock();
-                entry->setNext(NULL);
-                entry->setPrevious(NULL);
-                _pageAvailable++;
-                _pageTableLock.unlock();
-
-            // So check whether the page can be kept in memory or have to
-            // be swapped on the disk
-            } else 
-                __manageMemoryCache(entry);
-        }
+        __prefetchPages();
     }
 
-    DEBUGMSG(_("Cache controller unloaded. See ya"));
+    DEBUGMSG(_("Prefetch thread unloaded. See ya"));
     return NULL;
 }
 
@@ -323,43 +318,62 @@ static void* _cacheControllerThread(void *_exitVar)
  * Initialisation et clôture du cache
  * Cache initialization and uninitialization
  */
-bool initializeCache()
+bool initializeCache(const Request& request)
 {
-    // Load the cache controller thread
-    if (pthread_create(&_cacheThread, NULL, _cacheControllerThread, 
-        (void *)&_stopCacheControllerThread)) {
-        ERRORMSG(_("Cannot load the cache controller thread. Operation "
-            "aborted."));
+    unsigned long size;
+
+    // Keep the budget into an unsigned long on 32 bits targets
+    size = request.tuningValue("CacheSize", "SPLIX_CACHE_SIZE", CACHESIZE);
+    if (size > ULONG_MAX / (1024 * 1024))
+        size = ULONG_MAX / (1024 * 1024);
+    _memoryBudget = size * 1024 * 1024;
+    DEBUGMSG(_("Cache memory budget: %lu bytes"), _memoryBudget);
+
+    // Load the prefetch thread
+    if (pthread_create(&_prefetchThread, NULL, _prefetchThreadMain, NULL)) {
+        ERRORMSG(_("Cannot load the prefetch thread. Operation aborted."));
         return false;
     }
 
-    // Initialize the different cache variables
     return true;
 }
 
 bool uninitializeCache()
 {
-    void *threadResult;
     bool res = true;
 
-    // Stop the cache controller thread
-    _stopCacheControllerThread = true;
-    _work++;
-    if (pthread_join(_cacheThread, &threadResult)) {
-        ERRORMSG(_("An error occurred while waiting the end of the cache "
-            "controller thread"));
+    // Stop the prefetch thread
+    pthread_mutex_lock(&_prefetchLock);
+    _stopPrefetchThread = true;
+    pthread_cond_signal(&_prefetchCond);
+    pthread_mutex_unlock(&_prefetchLock);
+    if (pthread_join(_prefetchThread, NULL)) {
+        ERRORMSG(_("An error occurred while waiting the end of the prefetch "
+            "thread"));
         res = false;
     }
- 
+
     // Check if all pages has been read. Otherwise free them
-    for (unsigned long i=0; i < _maxPagesInTable; i++) {
-        if (_pages[i]) {
-            ERRORMSG(_("Cache: page %lu hasn't be used!"), i+1);
-            delete _pages[i]->page();
-            delete _pages[i];
+    for (unsigned long i=1; i <= _maxPageNr; i++) {
+        slot_t *slot = __slot(i, false);
+        unsigned long value;
+
+        if (!slot || !(value = slot->value))
+            continue;
+        ERRORMSG(_("Cache: page %lu hasn't be used!"), i);
+        delete ((CacheEntry *)(value & ~TAGS))->page();
+        delete (CacheEntry *)(value & ~TAGS);
+    }
+    for (unsigned long i=0; i < MAX_CHUNKS; i++) {
+        if (_chunks[i]) {
+            delete[] _chunks[i];
+            _chunks[i] = NULL;
         }
     }
-    delete[] _pages;
+    if (_swapFile != -1) {
+        close(_swapFile);
+        _swapFile = -1;
+    }
 
     return res;
 }
@@ -370,23 +384,72 @@ bool uninitializeCache()
  * Enregistrement d'une page dans le cache
  * Register a new page in the cache
  */
+static void __storePage(unsigned long nr, slot_t *slot, unsigned long value,
+    unsigned long size)
+{
+    slot->size = size;
+
+    // Keep the memory used by the pages under the budget
+    if (__sync_add_and_fetch(&_memoryUsed, size) > _memoryBudget && 
+        nr != _pageRequested)
+        value = __swapPages(nr, value, size);
+
+    __publishSlot(nr, slot, value);
+    if (value & SWAPPED_TAG)
+        __wakePrefetchThread();
+}
+
 void registerPage(Page* page)
 {
-    CacheEntry *entry;
-    
-    entry = new CacheEntry(page);
-    {
-        _waitingListLock.lock();
-        if (_lastWaitingList) {
-            _lastWaitingList->setNext(entry);
-            _lastWaitingList = entry;
-        } else {
-            _waitingList = entry;
-            _lastWaitingList = entry;
-        }
-        _waitingListLock.unlock();
+    unsigned long nr = page->pageNr(), value, max;
+    slot_t *slot;
+
+    if (!(slot = __slot(nr, true))) {
+        ERRORMSG(_("Cache: too many pages. Page %lu dropped"), nr);
+        // An incomplete page will be destroyed once completed
+        if (page->isComplete())
+            delete page;
+        return;
     }
-    _work++;
+    value = (unsigned long)new CacheEntry(page);
+    while ((max = _maxPageNr) < nr && 
+        !__sync_bool_compare_and_swap(&_maxPageNr, max, nr));
+
+    // An incomplete page is accounted once completed
+    if (page->isComplete())
+        __storePage(nr, slot, value, page->memorySize());
+    else {
+        slot->size = 0;
+        __publishSlot(nr, slot, value | STREAMING_TAG);
+    }
+
+#ifdef DUMP_CACHE
+    fprintf(stderr, _("DEBUG: [34mCache: page %lu registered (%lu bytes "
+        "into memory)[0m\n"), nr, _memoryUsed);
+#endif /* DUMP_CACHE */
+}
+
+void completePage(Page* page)
+{
+    unsigned long nr = page->pageNr(), size = page->memorySize(), value;
+    slot_t *slot = __slot(nr, false);
+
+    // The page could not be registered
+    if (!slot) {
+        page->setComplete(true);
+        delete page;
+        return;
+    }
+
+    // The page may already be rendered by the main thread
+    value = slot->value;
+    if (!(value & STREAMING_TAG) || 
+        !__sync_bool_compare_and_swap(&slot->value, value, 0)) {
+        page->setComplete(true);
+        return;
+    }
+    page->setComplete(true);
+    __storePage(nr, slot, value & ~STREAMING_TAG, size);
 }
 
 
@@ -397,80 +460,76 @@ void registerPage(Page* page)
  */
 Page* getNextPage()
 {
-    CacheEntry *entry = NULL;
-    unsigned long nr=0;
-    bool notUnregister = false;
+    unsigned long nr=0, value=0;
+    CachePolicy policy;
+    CacheEntry *entry;
+    slot_t *slot;
     Page *page;
 
-    // Get the next page number
-    switch (_policy) {
-        case EveryPagesIncreasing:
-            nr = _lastPageRequested + 1;
-            break;
-        case EvenDecreasing:
-            if (_lastPageRequested > 2)
-                nr = _lastPageRequested - 2;
-            else {
-                nr = 1;
-                setCachePolicy(OddIncreasing);
-            }
-            break;
-        case OddIncreasing:
-            if (!_lastPageRequested)
-                nr = 1;
-            else
-                nr = _lastPageRequested + 2;
-            break;
-    }
+    while (true) {
+        // Get the next page number
+        policy = _policy;
+        nr = __pageAfter(_lastPageRequested, policy);
+        if (policy != _policy)
+            setCachePolicy(policy);
+
+        DEBUGMSG(_("Next requested page : %lu (memory used=%lu/%lu)"), nr, 
+            _memoryUsed, _memoryBudget);
+
+        // Wait for the page
+        value = 0;
+        slot = __slot(nr, true);
+        while (slot) {
+            bool lastPage;
 
-    DEBUGMSG(_("Next requested page : %lu (# pages into memory=%lu/%u)"), nr, 
-        _pagesInMemory, CACHESIZE);
-
-    // Wait for the page
-    while (nr && (!_numberOfPages || _numberOfPages >= nr)) {
-        {
-            _pageTableLock.lock();
-            if (_maxPagesInTable >= nr && _pages[nr - 1] && 
-                !_pages[nr - 1]->isSwapped()) {
-                entry = _pages[nr - 1];
-                _pages[nr - 1] = NULL;
-                if (!entry->previous() && !entry->next() && entry != _inMemory)
-                    notUnregister = true;
-                if (entry->previous())
-                    entry->previous()->setNext(entry->next());
-                if (entry->next())
-                    entry->next()->setPrevious(entry->previous());
-                if (entry == _inMemory)
-                    _inMemory = entry->next();
-                if (entry == _inMemoryLast)
-                    _inMemoryLast = NULL;
-                _pageTableLock.unlock();
+            if ((value = __takeSlot(slot)))
                 break;
-            } else if (_maxPagesInTable >= nr && _pages[nr - 1] && 
-                _pages[nr - 1]->isSwapped())
-                _work++;
+
+            pthread_mutex_lock(&_waitLock);
             _pageRequested = nr;
-            _pageTableLock.unlock();
+            __sync_synchronize();
+            lastPage = _numberOfPagesKnown && _numberOfPages < nr;
+            if (!lastPage && !slot->value)
+                pthread_cond_wait(&_waitCond, &_waitLock);
+            pthread_mutex_unlock(&_waitLock);
+            if (lastPage)
+                break;
         }
-        _pageAvailable--;
-    };
+        _pageRequested = 0;
+
+        // Extract the page instance
+        if (!value)
+            return NULL;
+        entry = (CacheEntry *)(value & ~TAGS);
+        _lastPageRequested = nr;
+        if (!(value & SWAPPED_TAG)) {
+            __sync_sub_and_fetch(&_memoryUsed, slot->size);
+            break;
+        }
+        if (entry->restoreIntoMemory())
+            break;
 
-    // Extract the page instance
-    if (!entry)
-        return NULL;
-    _pagesInTable--;
-    _lastPageRequested = nr;
+        // The page is lost: continue with the next one
+        ERRORMSG(_("Page %lu cannot be restored from the disk and will not be "
+            "printed"), nr);
+        _lostPages = true;
+        entry->discard();
+        delete entry;
+    }
     page = entry->page();
     delete entry;
 
-    // Preload a new page
-    if (!notUnregister)
-        _pagesInMemory--;
-    _work++;
+    // Preload the next pages
+    __wakePrefetchThread();
 
     return page;
 }
 
+bool hasLostPages()
+{
+    return _lostPages;
+}
+
 
 
 /*
@@ -485,8 +544,10 @@ void setCachePolicy(CachePolicy policy)
     if (policy == EveryPagesIncreasing || policy == OddIncreasing)
         _lastPageRequested = 0;
     else {
-        while (!_numberOfPages)
-            _pageAvailable--;
+        pthread_mutex_lock(&_waitLock);
+        while (!_numberOfPagesKnown)
+            pthread_cond_wait(&_waitCond, &_waitLock);
+        pthread_mutex_unlock(&_waitLock);
         _lastPageRequested = (_numberOfPages & ~0x1) + 2;
     }
 }
@@ -499,8 +560,11 @@ void setCachePolicy(CachePolicy policy)
  */
 void setNumberOfPages(unsigned long nr)
 {
+    pthread_mutex_lock(&_waitLock);
     _numberOfPages = nr;
-    _pageAvailable++;
+    _numberOfPagesKnown = true;
+    pthread_cond_broadcast(&_waitCond);
+    pthread_mutex_unlock(&_waitLock);
 }
 
 
@@ -511,85 +575,116 @@ void setNumberOfPages(unsigned long nr)
  */
 CacheEntry::CacheEntry(Page* page)
 {
-    _tempFile = NULL;
-    _next = NULL;
     _page = page;
+    _swapped = false;
+    _offset = 0;
+    _swapSize = 0;
 }
 
 CacheEntry::~CacheEntry()
 {
-    if (_tempFile) {
+    if (_swapped)
         ERRORMSG(_("Destroy a cache entry which is still swapped on disk."));
-        unlink(_tempFile);
-        delete[] _tempFile;
+}
+
+static int __swapFile()
+{
+    char path[] = "/tmp/splixV2-cacheXXXXXX";
+    int fd;
+
+    pthread_mutex_lock(&_swapFileLock);
+    if (_swapFile == -1) {
+        if ((_swapFile = mkstemp(path)) == -1) {
+            ERRORMSG(_("Cannot create the cache swap file (%i)"), errno);
+        } else
+            // The file will be destroyed when it will be closed
+            unlink(path);
     }
+    fd = _swapFile;
+    pthread_mutex_unlock(&_swapFileLock);
+
+    return fd;
 }
 
 bool CacheEntry::swapToDisk()
 {
-    const char *path = "/tmp/splixV2-pageXXXXXX";
+    SpillWriter writer;
     int fd;
 
-    if (_tempFile) {
+    if (_swapped) {
         ERRORMSG(_("Trying to swap a page instance on the disk which is "
             "already swapped."));
         return false;
     }
-
-    // Create the temporarily file
-    _tempFile = new char[strlen(path)+1];
-    strcpy(_tempFile, path);
-    if ((fd = mkstemp(_tempFile)) == -1) {
-        delete[] _tempFile;
-        _tempFile = NULL;
-        ERRORMSG(_("Cannot swap a page into disk (%i)"), errno);
+    if ((fd = __swapFile()) == -1)
         return false;
-    }
 
-    // Swap the instance into the file
-    if (!_page->swapToDisk(fd)) {
-        unlink(_tempFile);
-        delete[] _tempFile;
-        _tempFile = NULL;
+    // Append the instance to the swap file
+    if (!_page->swapToDisk(writer)) {
         ERRORMSG(_("Cannot swap a page into disk"));
         return false;
     }
+    _swapSize = writer.size();
+    _offset = __sync_fetch_and_add(&_swapFileEnd, (off_t)_swapSize);
+    if (!writer.writeAt(fd, _offset)) {
+        ERRORMSG(_("Cannot swap a page into disk (%i)"), errno);
+        return false;
+    }
 
     DEBUGMSG(_("Page %lu swapped to disk"), _page->pageNr());
-    close(fd);
     delete _page;
     _page = NULL;
+    _swapped = true;
 
     return true;
 }
 
+void CacheEntry::discard()
+{
+    _swapped = false;
+}
+
 bool CacheEntry::restoreIntoMemory()
 {
-    int fd;
+    unsigned long done = 0;
+    unsigned char *buffer;
+    Page *page;
 
-    if (!_tempFile) {
+    if (!_swapped) {
         ERRORMSG(_("Trying to restore a page instance into memory which is "
             "aready into memory"));
         return false;
     }
 
-    // Open the swap file
-    if ((fd = open(_tempFile, O_RDONLY)) == -1) {
-        ERRORMSG(_("Cannot restore page into memory (%i)"), errno);
-        return false;
+    // Read the instance in one time into the arena of the new page
+    page = new Page();
+    buffer = (unsigned char *)page->arena().allocate(_swapSize);
+    while (done < _swapSize) {
+        ssize_t res = pread(_swapFile, buffer + done, _swapSize - done, 
+            _offset + done);
+
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0) {
+            ERRORMSG(_("Cannot restore page into memory (%i)"), errno);
+            delete page;
+            return false;
+        }
+        done += res;
     }
 
     // Restore the instance
-    if (!(_page = Page::restoreIntoMemory(fd))) {
-        ERRORMSG(_("Cannot restore page into memory"));
-        return false;
-    }
+    {
+        SpillReader reader(buffer, _swapSize);
 
-    // Destroy the swap file
-    close(fd);
-    unlink(_tempFile);
-    delete[] _tempFile;
-    _tempFile = NULL;
+        if (!page->restoreIntoMemory(reader)) {
+            ERRORMSG(_("Cannot restore page into memory"));
+            delete page;
+            return false;
+        }
+    }
+    _page = page;
+    _swapped = false;
 
     DEBUGMSG(_("Page %lu restored into memory"), _page->pageNr());
     return true;
@@ -19,76 +19,12 @@
  * 
  */
 #include "colors.h"
-#include "page.h"
+#include "kernels.h"
 
 #ifndef DISABLE_BLACKOPTIM
-void applyBlackOptimization(Page* page)
+void applyBlackOptimization(unsigned char* planes[4], unsigned long size)
 {
-    unsigned long size, sizeByUL, mod, mask;
-    unsigned char *planes[4], bmask;
-
-    // Only optimize colors if there are present
-    if (!page || page->colorsNr() != 4)
-        return;
-    for (unsigned int i=0; i < 4; i++) {
-        if (!(planes[i] = page->planeBuffer(i)))
-            return;
-    }
-
-    size = page->width() * page->height() / 8;
-    sizeByUL = size / sizeof(unsigned long);
-    mod = size % sizeof(unsigned long);
-
-
-    /*
-     * To optimize this algorithm, data are first evaluated by unsigned long
-     * (32-Bits on 32-Bits architecture and 64-Bits on 64-Bits architecture).
-     * The last bytes are evaluated individually if the size is not a multiple
-     * of the size of the unsigned long
-     */
-    for (unsigned long i=0; i < sizeByUL; i++) {
-        // Clear cyan, magenta and yellow dots if a black dot is present
-        mask = ((unsigned long *)planes[3])[i];
-        if (mask) {
-            ((unsigned long *)planes[0])[i] &= ~mask;
-            ((unsigned long *)planes[1])[i] &= ~mask;
-            ((unsigned long *)planes[2])[i] &= ~mask;
-        }
-
-        // Set a black dot if cyan, magenta and yellow dots are present and
-        // clear them
-        mask = ((unsigned long *)planes[0])[i];
-        mask &= ((unsigned long *)planes[1])[i];
-        mask &= ((unsigned long *)planes[2])[i];
-        if (mask) {
-            ((unsigned long *)planes[3])[i] |= mask;
-            ((unsigned long *)planes[0])[i] &= ~mask;
-            ((unsigned long *)planes[1])[i] &= ~mask;
-            ((unsigned long *)planes[2])[i] &= ~mask;
-        }
-    }
-
-    for (unsigned long i=1; i <= mod; i++) {
-        // Clear cyan, magenta and yellow dots if a black dot is present
-        bmask = planes[3][size - i];
-        if (bmask) {
-            planes[0][size - i] &= ~bmask;
-            planes[1][size - i] &= ~bmask;
-            planes[2][size - i] &= ~bmask;
-        }
-
-        // Set a black dot if cyan, magenta and yellow dots are present and
-        // clear them
-        bmask = planes[0][size - i];
-        bmask &= planes[1][size - i];
-        bmask &= planes[2][size - i];
-        if (bmask) {
-            planes[3][size - i] |= bmask;
-            planes[0][size - i] &= ~bmask;
-            planes[1][size - i] &= ~bmask;
-            planes[2][size - i] &= ~bmask;
-        }
-    }
+    optimizeBlack(planes, size);
 }
 
 #endif /* DISABLE_BLACKOPTIM */
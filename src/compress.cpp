@@ -21,11 +21,18 @@
 #include "compress.h"
 #include <math.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
 #include "page.h"
 #include "band.h"
+#include "arena.h"
 #include "errlog.h"
+#include "kernels.h"
 #include "request.h"
+#include "document.h"
 #include "bandplane.h"
+#include "workerpool.h"
 
 #include "algo0x0d.h"
 #include "algo0x0e.h"
@@ -33,168 +40,669 @@
 #include "algo0x13.h"
 #include "algo0x15.h"
 
-static bool _isEmptyBand(unsigned char* band, unsigned long size)
+/*
+ * Nombre de tranches de bandes lues à l'avance pour les pages en flux
+ * Number of band slabs read ahead for streamed pages
+ */
+#define STREAMING_SLABS         4
+
+/*
+ * Statistiques de la prédiction de l'algorithme 0xd
+ * Statistics of the algorithm 0xd prediction
+ */
+static volatile unsigned long _0x0DEncodedNr = 0;
+static volatile unsigned long _0x0DPredictedNr = 0;
+static volatile unsigned long _0x0DMispredictedNr = 0;
+
+/*
+ * Lignes encrées
+ * Inked lines
+ *
+ * The reader records the colors inked by each line of a page. A band whose
+ * lines have no ink for a color is blank and doesn't need to be scanned.
+ * Without this information, the band is considered as inked.
+ */
+static bool _isInked(const unsigned char* ink, unsigned char color, 
+    unsigned long nr)
 {
-    unsigned long max, mod;
+    if (!ink)
+        return true;
+    for (unsigned long i=0; i < nr; i++)
+        if (ink[i] & (1 << color))
+            return true;
+    return false;
+}
 
-    max = size / sizeof(unsigned long);
-    mod = size % sizeof(unsigned long);
+/*
+ * Copie des lignes d'une bande
+ * Copy of band lines
+ *
+ * The bytes are XORed with mask to invert them when needed.
+ */
+static void _copyBandLines(unsigned char* band, const unsigned char* plane,
+    unsigned long lineWidthInB, unsigned long widthInB, unsigned long height,
+    unsigned char mask)
+{
+    for (unsigned long y=0; y < height; y++) {
+        unsigned char *dst = band + y * lineWidthInB;
+        const unsigned char *src = plane + y * lineWidthInB;
 
-    for (unsigned long i=0; i < max; i++) {
-        if (((unsigned long*)band)[i])
-            return false;
+        for (unsigned long x=0; x < widthInB; x++)
+            dst[x] = src[x] ^ mask;
+        memset(dst + widthInB, mask, lineWidthInB - widthInB);
     }
-    for (unsigned long i=0; i < mod; i++)
-        if (band[size-i-1])
-            return false;
-    return true;
 }
 
-static bool _compressBandedPage(const Request& request, Page* page)
+/*
+ * Transposition d'une bande
+ * Band transposition
+ *
+ * The band is stored column by column: byte (x, y) of the plane goes to
+ * band[x * bandHeight + y]. The copy is done by 16x16 tiles so that the
+ * stores of a tile fill whole cache lines. With SSE2, each tile is
+ * transposed in registers by four rounds of byte unpacking. The bytes are
+ * XORed with mask to invert them when needed.
+ */
+static void _transposeTile(unsigned char* band, const unsigned char* plane,
+    unsigned long lineWidthInB, unsigned long bandHeight, unsigned long width,
+    unsigned long height, unsigned char mask)
 {
-    unsigned long index=0, pageHeight, pageWidth, lineWidthInB, bandHeight;
-    unsigned long bandSize, hardMarginX, hardMarginXInB, hardMarginY;
-    unsigned char *planes[4], *band;
-    unsigned long bandNumber=0;
-    unsigned char colors;
+    for (unsigned long x=0; x < width; x++)
+        for (unsigned long y=0; y < height; y++)
+            band[x * bandHeight + y] = plane[x + y * lineWidthInB] ^ mask;
+}
+
+static void _transposeBand(unsigned char* band, const unsigned char* plane,
+    unsigned long lineWidthInB, unsigned long widthInB, 
+    unsigned long bandHeight, unsigned long height, unsigned char mask)
+{
+    for (unsigned long y=0; y < height; y += 16) {
+        unsigned long tileHeight = height - y < 16 ? height - y : 16;
+
+        for (unsigned long x=0; x < widthInB; x += 16) {
+            unsigned long tileWidth = widthInB - x < 16 ? widthInB - x : 16;
+            unsigned char *dst = band + x * bandHeight + y;
+            const unsigned char *src = plane + x + y * lineWidthInB;
+
+#ifdef __SSE2__
+            if (tileWidth == 16 && tileHeight == 16) {
+                __m128i rows[16], tmp[16];
+                __m128i masks = _mm_set1_epi8((char)mask);
+
+                for (unsigned int i=0; i < 16; i++)
+                    rows[i] = _mm_xor_si128(masks, _mm_loadu_si128(
+                        (const __m128i *)(src + i * lineWidthInB)));
+                for (unsigned int round=0; round < 4; round++) {
+                    for (unsigned int i=0; i < 8; i++) {
+                        tmp[2*i] = _mm_unpacklo_epi8(rows[i], rows[i+8]);
+                        tmp[2*i+1] = _mm_unpackhi_epi8(rows[i], rows[i+8]);
+                    }
+                    for (unsigned int i=0; i < 16; i++)
+                        rows[i] = tmp[i];
+                }
+                for (unsigned int i=0; i < 16; i++)
+                    _mm_storeu_si128((__m128i *)(dst + i * bandHeight), 
+                        rows[i]);
+                continue;
+            }
+#endif /* __SSE2__ */
+            _transposeTile(dst, src, lineWidthInB, bandHeight, tileWidth, 
+                tileHeight, mask);
+        }
+    }
+}
+
+
+
+/*
+ * Contextes de compression réutilisables
+ * Reusable compression contexts
+ *
+ * A context holds the band encoders and the band buffer used by one job at a
+ * time. It goes back to a free list when the job is done, so that each thread
+ * reuses the same encoders and buffer for all the bands instead of allocating
+ * them again for each band.
+ */
+static Algorithm* _newBandAlgorithm(unsigned long compression)
+{
+    switch (compression) {
+        case 0x0D:
+            return new Algo0x0D;
+        case 0x0E:
+            return new Algo0x0E;
+        case 0x11:
+            return new Algo0x11;
+    }
+    return NULL;
+}
+
+class EncoderContext
+{
+    protected:
+        Algorithm*              _encoders[3];
+        unsigned char*          _band;
+        unsigned long           _bandSize;
+
+    public:
+        EncoderContext*         next;
+
+    public:
+        EncoderContext();
+        ~EncoderContext();
+
+    public:
+        Algorithm*              encoder(unsigned long compression);
+        unsigned char*          band(unsigned long size);
+};
+
+static EncoderContext* _freeContexts = NULL;
+#ifndef DISABLE_THREADS
+static Semaphore _contextsLock;
+#endif /* DISABLE_THREADS */
+
+EncoderContext::EncoderContext()
+{
+    for (unsigned int i=0; i < 3; i++)
+        _encoders[i] = NULL;
+    _band = NULL;
+    _bandSize = 0;
+    next = NULL;
+}
+
+EncoderContext::~EncoderContext()
+{
+    for (unsigned int i=0; i < 3; i++)
+        if (_encoders[i])
+            delete _encoders[i];
+    if (_band)
+        delete[] _band;
+}
+
+Algorithm* EncoderContext::encoder(unsigned long compression)
+{
+    unsigned int i;
+
+    switch (compression) {
+        case 0x0D:
+            i = 0;
+            break;
+        case 0x0E:
+            i = 1;
+            break;
+        case 0x11:
+            i = 2;
+            break;
+        default:
+            return NULL;
+    }
+    if (!_encoders[i])
+        _encoders[i] = _newBandAlgorithm(compression);
+    return _encoders[i];
+}
+
+unsigned char* EncoderContext::band(unsigned long size)
+{
+    // The buffer only grows, when the resolution of a page changes
+    if (size > _bandSize) {
+        if (_band)
+            delete[] _band;
+        _band = new unsigned char[size];
+        _bandSize = size;
+    }
+    return _band;
+}
+
+static EncoderContext* _takeContext()
+{
+    EncoderContext *context;
+
+#ifndef DISABLE_THREADS
+    _contextsLock.lock();
+#endif /* DISABLE_THREADS */
+    context = _freeContexts;
+    if (context)
+        _freeContexts = context->next;
+#ifndef DISABLE_THREADS
+    _contextsLock.unlock();
+#endif /* DISABLE_THREADS */
+
+    return context ? context : new EncoderContext();
+}
+
+static void _releaseContext(EncoderContext* context)
+{
+#ifndef DISABLE_THREADS
+    _contextsLock.lock();
+#endif /* DISABLE_THREADS */
+    context->next = _freeContexts;
+    _freeContexts = context;
+#ifndef DISABLE_THREADS
+    _contextsLock.unlock();
+#endif /* DISABLE_THREADS */
+}
+
+
+
+/*
+ * Compression d'une couleur d'une bande
+ * Compression of a band color
+ */
+class BandJob : public Job
+{
+    protected:
+        const Request*          _request;
+        Arena*                  _arena;
+        unsigned long           _compression;
+        const unsigned char*    _plane;
+        unsigned long           _index;
+        unsigned long           _lineWidthInB;
+        unsigned long           _hardMarginXInB;
+        unsigned long           _pageWidth;
+        unsigned long           _bandHeight;
+        unsigned long           _localHeight;
+        unsigned char           _colorNr;
+        bool                    _inked;
+        BandPlane*              _result;
+
+    public:
+        BandJob(const Request& request, Arena& arena, unsigned long compression,
+            const unsigned char* plane, unsigned long index,
+            unsigned long lineWidthInB, unsigned long hardMarginXInB,
+            unsigned long pageWidth, unsigned long bandHeight,
+            unsigned long localHeight, unsigned char colorNr, bool inked);
+        virtual ~BandJob() {}
+
+    public:
+        BandPlane*              result() const {return _result;}
+
+    public:
+        virtual void            run();
+};
+
+BandJob::BandJob(const Request& request, Arena& arena, 
+    unsigned long compression, const unsigned char* plane, unsigned long index,
+    unsigned long lineWidthInB,
+    unsigned long hardMarginXInB, unsigned long pageWidth,
+    unsigned long bandHeight, unsigned long localHeight, unsigned char colorNr,
+    bool inked)
+{
+    _request = &request;
+    _arena = &arena;
+    _compression = compression;
+    _plane = plane;
+    _index = index;
+    _lineWidthInB = lineWidthInB;
+    _hardMarginXInB = hardMarginXInB;
+    _pageWidth = pageWidth;
+    _bandHeight = bandHeight;
+    _localHeight = localHeight;
+    _colorNr = colorNr;
+    _inked = inked;
+    _result = NULL;
+}
+
+void BandJob::run()
+{
+    unsigned long bandSize = _lineWidthInB * _bandHeight;
+    unsigned long widthInB = _lineWidthInB - _hardMarginXInB;
+    EncoderContext *context;
+    unsigned char *band, blank;
+    Algorithm *algo;
+    BandPlane *plane;
+
+    // Nothing to do if the reader has seen no ink on the band lines
+    _result = NULL;
+    if (!_inked)
+        return;
+    context = _takeContext();
+    algo = context->encoder(_compression);
+    band = context->band(bandSize);
+
+    // The bytes are inverted while they are copied if needed
+    blank = algo->inverseByte() ? 0xFF : 0;
+
+    // Special things to do for the last band
+    if (_localHeight < _bandHeight)
+        memset(band, blank, bandSize);
+
+    // Copy the data into the band depending on the algorithm options
+    if (algo->reverseLineColumn()) {
+        _transposeBand(band, _plane + _index + _hardMarginXInB, _lineWidthInB,
+            widthInB, _bandHeight, _localHeight, blank);
+        memset(band + widthInB * _bandHeight, blank, _hardMarginXInB * 
+            _bandHeight);
+    } else
+        _copyBandLines(band, _plane + _index + _hardMarginXInB, _lineWidthInB,
+            widthInB, _localHeight, blank);
+
+    // Does the band is empty?
+    if (isBlankBuffer(band, bandSize, blank)) {
+        _releaseContext(context);
+        return;
+    }
+
+    // Call the compression method unless algorithm 0xd will surely give up
+    if (_compression == 0x0D && ((Algo0x0D *)algo)->mustGiveUp(band, 
+        _pageWidth, _bandHeight)) {
+        __sync_fetch_and_add(&_0x0DPredictedNr, 1);
+        plane = NULL;
+    } else {
+        plane = algo->compress(*_request, band, _pageWidth, _bandHeight, 
+            *_arena);
+        if (_compression == 0x0D)
+            __sync_fetch_and_add(plane ? &_0x0DEncodedNr : 
+                &_0x0DMispredictedNr, 1);
+    }
+    /*
+     * If algorithm 0xd did not create a plane, it means that the 
+     * complementary algorithm 0xE need to be used
+     */
+    if (!plane && _compression == 0x0D) {
+        algo = context->encoder(0x0E);
+        /* Bytes has to be reversed first, as algo0xd didn't do that. */
+        for (unsigned int j = 0; j < bandSize; j++)
+            band[j] = ~band[j];
+        /* Do the encoding with algo0xe. */
+        plane = algo->compress(*_request, band, _pageWidth, _bandHeight, 
+            *_arena);
+    }
+    if (plane)
+        plane->setColorNr(_colorNr);
+    _result = plane;
+
+    _releaseContext(context);
+}
+
+static void _computeBandedGeometry(const Request& request, Page* page,
+    unsigned long& hardMarginXInB, unsigned long& hardMarginY, 
+    unsigned long& bandHeight)
+{
+    unsigned long hardMarginX;
 
-    colors = page->colorsNr();
     hardMarginX = ((unsigned long)ceil(page->convertToXResolution(request.
         printer()->hardMarginX())) + 7) & ~7;
     hardMarginY = ceil(page->convertToYResolution(request.printer()->
         hardMarginY()));
     hardMarginXInB = hardMarginX / 8;
-    pageWidth = page->width();
-    pageHeight = page->height() - hardMarginY;
-    page->setWidth(pageWidth);
-    page->setHeight(pageHeight);
-    lineWidthInB = (pageWidth + 7) / 8;
     bandHeight = request.printer()->bandHeight();
     if (page->xResolution() == 300 && page->yResolution() == 300)
         bandHeight /= 2;
+}
+
+static void _registerBand(Page* page, Job** jobs, unsigned long nr,
+    unsigned char colors, unsigned long pageWidth, unsigned long bandHeight)
+{
+    Band *current = NULL;
+
+    // Gather the compressed colors of the band then destroy their jobs
+    for (unsigned int i=0; i < colors; i++) {
+        BandPlane *plane = ((BandJob *)jobs[i])->result();
+
+        if (plane) {
+            if (!current)
+                current = new (page->arena()) Band(nr, pageWidth, bandHeight);
+            current->registerPlane(plane);
+        }
+        delete jobs[i];
+    }
+    if (current)
+        page->registerBand(current);
+}
+
+static bool _compressBandedPage(const Request& request, Page* page)
+{
+    unsigned long index=0, pageHeight, pageWidth, lineWidthInB, bandHeight;
+    unsigned long bandSize, hardMarginXInB, hardMarginY, bandsNr, jobsNr;
+    const unsigned char *ink = page->inkLines();
+    unsigned char *planes[4];
+    unsigned char colors;
+    Job **jobs;
+
+    switch (page->compression()) {
+        case 0x0D:
+        case 0x0E:
+        case 0x11:
+            break;
+        default:
+            ERRORMSG(_("Unknown compression algorithm. Aborted"));
+            return false;
+    }
+
+    colors = page->colorsNr();
+    _computeBandedGeometry(request, page, hardMarginXInB, hardMarginY, 
+        bandHeight);
+    page->setHeight(page->height() - hardMarginY);
+
+    // A blank page has no bands
+    if (page->isBlank()) {
+        page->flushPlanes();
+        return true;
+    }
+
+    pageWidth = page->width();
+    pageHeight = page->height();
+    lineWidthInB = (pageWidth + 7) / 8;
     bandSize = lineWidthInB * bandHeight;
     index = hardMarginY * lineWidthInB;
-    band = new unsigned char[bandSize];
     for (unsigned int i=0; i < colors; i++)
         planes[i] = page->planeBuffer(i);
 
     /*
-     * 1. On vérifier si la bande n'est pas blanche
+     * 1. Chaque couleur de chaque bande est une tâche indépendante exécutée
+     *    par le groupe de threads:
      *      |-> Si bande blanche, on passe
      *      '-> Sinon, on compresse
      * 2. On rajoute les informations de bande (numéro de bande et de
-     *    couleur).
+     *    couleur) dans l'ordre des bandes.
      * 3. On enregistre la bande dans la page.
      * 4. On détruit les buffers de plans dans la page.
      */
-    while (pageHeight) {
+    bandsNr = (pageHeight + bandHeight - 1) / bandHeight;
+    jobsNr = bandsNr * colors;
+    jobs = new Job*[jobsNr];
+    for (unsigned long nr=0; nr < bandsNr; nr++) {
         unsigned long localHeight = bandHeight;
-        Band *current = NULL;
-        bool theEnd = false;
 
         // Special things to do for the last band
-        if (pageHeight < bandHeight) {
-            theEnd = true;
-            localHeight = pageHeight;
-            memset(band, 0, bandSize);
-        }
+        if (pageHeight - nr * bandHeight < bandHeight)
+            localHeight = pageHeight - nr * bandHeight;
+        for (unsigned int i=0; i < colors; i++)
+            jobs[nr * colors + i] = new BandJob(request, page->arena(),
+                page->compression(), planes[i], index, lineWidthInB, 
+                hardMarginXInB, pageWidth, bandHeight, localHeight, i + 1,
+                _isInked(ink ? ink + hardMarginY + nr * bandHeight : NULL, i,
+                localHeight));
+        index += bandSize;
+    }
+    runJobs(jobs, jobsNr);
+    for (unsigned long nr=0; nr < bandsNr; nr++)
+        _registerBand(page, &jobs[nr * colors], nr, colors, pageWidth, 
+            bandHeight);
+    delete[] jobs;
+    page->flushPlanes();
 
-        for (unsigned int i=0; i < colors; i++) {
-            Algorithm *algo = NULL;
-            BandPlane *plane;
-
-            switch (page->compression()) {
-                case 0x0D:
-                    algo = new Algo0x0D;
-                    break;
-                case 0x0E:
-                    algo = new Algo0x0E;
-                    break;
-                case 0x11:
-                    algo = new Algo0x11;
-                    break;
-                default:
-                    ERRORMSG(_("Unknown compression algorithm. Aborted"));
-                    return false;
-            }
+    return true;
+}
 
-            // Copy the data into the band depending on the algorithm options
-            if (algo->reverseLineColumn()) {
-                for (unsigned int y=0; y < localHeight; y++) {
-                    for (unsigned int x=0; x < lineWidthInB - hardMarginXInB; x++) {
-                        band[x * bandHeight + y] = planes[i][index + x +
-                            hardMarginXInB + y * lineWidthInB];
-                    }
-                    for (unsigned int x=lineWidthInB - hardMarginXInB; x < lineWidthInB; x++)
-                        band[x * bandHeight + y] = 0;
-                }
-            } else {
-                for (unsigned int y=0; y < localHeight; y++) {
-                    for (unsigned int x=0; x < lineWidthInB - hardMarginXInB; x++) {
-                        band[x + y * lineWidthInB] = planes[i][index + x +
-                            hardMarginXInB + y * lineWidthInB];
-                    }
-                    for (unsigned int x=lineWidthInB - hardMarginXInB; x < lineWidthInB; x++)
-                        band[x + y * lineWidthInB]  = 0;
-                }
-            }
+static bool _compressStreamedBandedPage(const Request& request, Page* page,
+    Document& document)
+{
+    unsigned long pageHeight, pageWidth, lineWidthInB, bandHeight, bandSize;
+    unsigned long hardMarginXInB, hardMarginY, bandsNr, queuedNr=0;
+    unsigned long registeredNr=0;
+    unsigned char *slabs[STREAMING_SLABS][4], *ink;
+    JobGroup groups[STREAMING_SLABS];
+    unsigned char colors;
+    bool res = true;
+    Job **jobs;
 
-            // Does the band is empty?
-            if (_isEmptyBand(band, bandSize)) {
-                delete algo;
-                continue;
-            }
+    // The page height has already been updated by prepareStreamedPage
+    colors = page->colorsNr();
+    _computeBandedGeometry(request, page, hardMarginXInB, hardMarginY, 
+        bandHeight);
+    pageWidth = page->width();
+    pageHeight = page->height();
+    lineWidthInB = (pageWidth + 7) / 8;
+    bandSize = lineWidthInB * bandHeight;
+    for (unsigned int j=0; j < STREAMING_SLABS; j++)
+        for (unsigned int i=0; i < colors; i++)
+            slabs[j][i] = new unsigned char[bandSize];
+    ink = new unsigned char[bandHeight];
 
-            // Check if bytes have to be reversed
-            if (algo->inverseByte())
-                for (unsigned int j=0; j < bandSize; j++)
-                    band[j] = ~band[j];
-
-            // Call the compression method
-            plane = algo->compress(request, band, pageWidth, bandHeight);
-            /*
-             * If algorithm 0xd did not create a plane, it means that the 
-             * complementary algorithm 0xE need to be used
-             */
-            if (!plane && page->compression() == 0x0D) {
-                delete algo;
-                algo = new Algo0x0E;
-                /* Bytes has to be reversed first, as algo0xd didn't do that. */
-                for (unsigned int j = 0; j < bandSize; j++)
-                    band[j] = ~band[j];
-                /* Do the encoding with algo0xe. */
-                plane = algo->compress(request, band, pageWidth, bandHeight);
-            }
+    /*
+     * 1. Les lignes de la marge du haut sont ignorées.
+     * 2. Chaque bande est lue dans une tranche libre puis ses couleurs sont
+     *    confiées au groupe de threads pendant la lecture de la suivante.
+     * 3. Une bande est enregistrée dans la page, dans l'ordre, dès que sa
+     *    tranche est libérée, pour pouvoir être envoyée à l'imprimante.
+     */
+    for (unsigned long skip=hardMarginY; skip && res;) {
+        unsigned long nr = skip < bandHeight ? skip : bandHeight;
 
-            if (plane) {
-                plane->setColorNr(i + 1);
-                if (!current)
-                    current = new Band(bandNumber, pageWidth, bandHeight);
-                current->registerPlane(plane);
-            }
+        res = document.readLines(slabs[0], nr);
+        skip -= nr;
+    }
+    bandsNr = (pageHeight + bandHeight - 1) / bandHeight;
+    jobs = new Job*[bandsNr * colors];
+    for (unsigned long nr=0; nr < bandsNr && res; nr++) {
+        unsigned char **slab = slabs[nr % STREAMING_SLABS];
+        unsigned long localHeight = bandHeight;
 
-            delete algo;
+        // Wait for the jobs which were using this slab and register the band
+        if (nr >= STREAMING_SLABS) {
+            groups[nr % STREAMING_SLABS].wait();
+            _registerBand(page, &jobs[registeredNr * colors], registeredNr,
+                colors, pageWidth, bandHeight);
+            registeredNr++;
         }
-        if (current)
-            page->registerBand(current);
-        bandNumber++;
-        index += bandSize;
-        pageHeight = theEnd ? 0 : pageHeight - bandHeight;
+
+        // Special things to do for the last band
+        if (pageHeight - nr * bandHeight < bandHeight)
+            localHeight = pageHeight - nr * bandHeight;
+        if (!(res = document.readLines(slab, localHeight, ink)))
+            break;
+
+        for (unsigned int i=0; i < colors; i++)
+            jobs[nr * colors + i] = new BandJob(request, page->arena(),
+                page->compression(), slab[i], 0, lineWidthInB, 
+                hardMarginXInB, pageWidth, bandHeight, localHeight, i + 1,
+                _isInked(ink, i, localHeight));
+        groups[nr % STREAMING_SLABS].queue(&jobs[nr * colors], colors);
+        queuedNr++;
+    }
+
+    // Register the last bands
+    for (; registeredNr < queuedNr; registeredNr++) {
+        groups[registeredNr % STREAMING_SLABS].wait();
+        _registerBand(page, &jobs[registeredNr * colors], registeredNr, colors,
+            pageWidth, bandHeight);
+    }
+    delete[] jobs;
+    for (unsigned int j=0; j < STREAMING_SLABS; j++)
+        for (unsigned int i=0; i < colors; i++)
+            delete[] slabs[j][i];
+    delete[] ink;
+
+    if (!res) {
+        ERRORMSG(_("Cannot read the bitmap of the page %lu"), page->pageNr());
+        return false;
     }
-    page->flushPlanes();
-    delete[] band;
 
     return true;
 }
 
 #ifndef DISABLE_JBIG
+/*
+ * Compression JBIG d'une couleur d'une bande
+ * JBIG compression of a band color
+ */
+class JBIGBandJob : public Job
+{
+    protected:
+        const Algo0x15*         _algo;
+        Arena*                  _arena;
+        const unsigned char*    _plane;
+        unsigned long           _lineWidthInB;
+        unsigned long           _copyWidthInB;
+        unsigned long           _bufferWidth;
+        unsigned long           _bandHeight;
+        unsigned long           _localHeight;
+        unsigned char           _bih[20];
+        BandPlane*              _result;
+
+    public:
+        JBIGBandJob(const Algo0x15* algo, Arena& arena, 
+            const unsigned char* plane, unsigned long lineWidthInB,
+            unsigned long copyWidthInB, unsigned long bufferWidth,
+            unsigned long bandHeight, unsigned long localHeight);
+        virtual ~JBIGBandJob() {}
+
+    public:
+        BandPlane*              result() const {return _result;}
+        const unsigned char*    bih() const {return _bih;}
+
+    public:
+        virtual void            run();
+};
+
+JBIGBandJob::JBIGBandJob(const Algo0x15* algo, Arena& arena, 
+    const unsigned char* plane, unsigned long lineWidthInB, 
+    unsigned long copyWidthInB, unsigned long bufferWidth,
+    unsigned long bandHeight, unsigned long localHeight)
+{
+    _algo = algo;
+    _arena = &arena;
+    _plane = plane;
+    _lineWidthInB = lineWidthInB;
+    _copyWidthInB = copyWidthInB;
+    _bufferWidth = bufferWidth;
+    _bandHeight = bandHeight;
+    _localHeight = localHeight;
+    _result = NULL;
+}
+
+void JBIGBandJob::run()
+{
+    unsigned long bufferWidthInB = (_bufferWidth + 7) / 8;
+    unsigned long bandSize = bufferWidthInB * _bandHeight;
+    EncoderContext *context = _takeContext();
+    unsigned char *band = context->band(bandSize);
+
+    // Copy the band lines and blank the remaining bytes
+    for (unsigned long y=0; y < _localHeight; y++) {
+        memcpy(band + y * bufferWidthInB, _plane + y * _lineWidthInB, 
+            _copyWidthInB);
+        memset(band + y * bufferWidthInB + _copyWidthInB, 0, bufferWidthInB -
+            _copyWidthInB);
+    }
+    memset(band + _localHeight * bufferWidthInB, 0, (_bandHeight - 
+        _localHeight) * bufferWidthInB);
+
+    _result = _algo->encode(band, _bufferWidth, _bandHeight, *_arena, _bih);
+    _releaseContext(context);
+}
+
+static bool _isEmptyRegion(const unsigned char* plane, 
+    unsigned long lineWidthInB, unsigned long widthInB, unsigned long height,
+    const unsigned char* ink, unsigned char color)
+{
+    // Only the lines where the reader has seen ink are scanned
+    for (unsigned long y=0; y < height; y++)
+        if ((!ink || ink[y] & (1 << color)) && 
+            !isBlankBuffer(plane + y * lineWidthInB, widthInB, 0))
+            return false;
+    return true;
+}
+
 static bool _compressBandedJBIGPage(const Request& request, Page* page)
 {
     unsigned long index=0, pageHeight, lineWidthInB, bandHeight = 128;
-    unsigned long bufferWidth, bandSize, hardMarginXInB=13, hardMarginY=100;
-    unsigned char *planes[4], *band[4];
-    unsigned long bandNumber=0, xLimitInB, bufferWidthInB;
-    Algo0x15 *algo = new Algo0x15;
+    unsigned long bufferWidth, hardMarginXInB=13, hardMarginY=100;
+    unsigned long bandsNr, jobsNr=0, xLimitInB, bufferWidthInB, copyWidthInB;
+    unsigned long colorsNr = page->colorsNr();
+    JBIGBandJob **jobs;
+    Job **queue;
+    Algo0x15 algo;
     /* Image trimming are done from hardware margins defined in the ppd. */
     hardMarginXInB = ((unsigned long)ceil(page->convertToXResolution(request.
         printer()->hardMarginX())) + 7) / 8;
@@ -212,13 +720,15 @@ static bool _compressBandedJBIGPage(const Request& request, Page* page)
     page->setHeight(pageHeight);
     // Update the page width.
     page->setWidth(bufferWidth);
-    bufferWidthInB = (bufferWidth + 7) / 8;
-    bandSize = bufferWidthInB * bandHeight;
-    index = hardMarginY * lineWidthInB;
-    for (unsigned int i=0; i < page->colorsNr(); i++) {
-        band[i] = new unsigned char[bandSize];
-        planes[i] = page->planeBuffer(i);
+
+    // A blank page has no bands
+    if (page->isBlank()) {
+        page->flushPlanes();
+        return true;
     }
+
+    bufferWidthInB = (bufferWidth + 7) / 8;
+    index = hardMarginY * lineWidthInB + hardMarginXInB;
     /*
        Here, limit the width of the copied image to the buffer, as the buffer
        width varies and can lead to 6 practical cases, the following is a
@@ -228,83 +738,136 @@ static bool _compressBandedJBIGPage(const Request& request, Page* page)
         xLimitInB = hardMarginXInB + bufferWidthInB;
     else
         xLimitInB = lineWidthInB - hardMarginXInB;
-    bool theEnd = false;
-    unsigned long indexSizeIncrement = bandHeight * lineWidthInB;
-    unsigned long localHeight = bandHeight;
-    while (pageHeight) {
-        Band *current = NULL;
+    copyWidthInB = xLimitInB - hardMarginXInB;
+    algo.loadPacketSize(request);
+
+    // Select the band colors to compress. Every color of a band is
+    // compressed if one of the CMY planes has data. Otherwise only the K
+    // plane is compressed if it has data
+    bandsNr = (pageHeight + bandHeight - 1) / bandHeight;
+    jobs = new JBIGBandJob*[bandsNr * colorsNr];
+    queue = new Job*[bandsNr * colorsNr];
+    for (unsigned long b=0; b < bandsNr; b++, index += bandHeight * 
+        lineWidthInB) {
+        unsigned long localHeight = pageHeight - b * bandHeight < bandHeight ?
+            pageHeight - b * bandHeight : bandHeight;
+        const unsigned char *bandInk = page->inkLines() ? page->inkLines() +
+            hardMarginY + b * bandHeight : NULL;
         bool cmyPlanesHasData = false;
-        // Special things to do for the last band
-        if (pageHeight < bandHeight) {
-            theEnd = true;
-            localHeight = pageHeight;
-            for (unsigned int i=0; i < page->colorsNr(); i++)
-                memset(band[i], 0, bandSize);
-        }
-        for (unsigned int i=0; i < page->colorsNr(); i++) {
-            for (unsigned int y=0; y < localHeight; y++) {
-                for (unsigned int x=hardMarginXInB; x < xLimitInB; x++)
-                    band[i][x - hardMarginXInB + y * bufferWidthInB] =
-                             planes[i][index + x + y * lineWidthInB];
-                for (unsigned int x=lineWidthInB - 2 * hardMarginXInB;
-                                  x < bufferWidthInB; x++)
-                    band[i][x + y * bufferWidthInB] = 0;
-            }
-        }
-        // Are the CMY planes completely empty in the band?
 
-        for (int i=0; i < page->colorsNr() - 1; i++)
-            if (!_isEmptyBand(band[i], bandSize)) { 
+        for (unsigned long i=0; i < colorsNr; i++)
+            jobs[b * colorsNr + i] = NULL;
+        for (unsigned long i=0; i + 1 < colorsNr; i++)
+            if (!_isEmptyRegion(page->planeBuffer(i) + index, lineWidthInB, 
+                copyWidthInB, localHeight, bandInk, i)) {
                 cmyPlanesHasData = true;
                 break;
-            };
-        // Compress the entire band.
-        if (cmyPlanesHasData) {
-            for (unsigned int i=0; i < page->colorsNr(); i++) {
-                BandPlane *plane = algo->compress(request, band[i],
-                                                  bufferWidth, bandHeight);
-                if (plane) {
-                    plane->setColorNr((1 == page->colorsNr()) ? 4:i + 1);
-                    if (!current)
-                        current = new Band(bandNumber, bufferWidth, bandHeight);
-                    current->registerPlane(plane);
-                }
-            }
-        } else if (!_isEmptyBand(band[page->colorsNr() - 1], bandSize)) { 
-            // Compress only the K band.
-            BandPlane *plane = algo->compress(request,
-                                              band[page->colorsNr() - 1],
-                                              bufferWidth, bandHeight);
-            if (plane) {
-                plane->setColorNr(4);
-                if (!current)
-                    current = new Band(bandNumber, bufferWidth, bandHeight);
-                current->registerPlane(plane);
             }
+        for (unsigned long i=0; i < colorsNr; i++) {
+            if (!cmyPlanesHasData && (i + 1 < colorsNr || _isEmptyRegion(
+                page->planeBuffer(i) + index, lineWidthInB, copyWidthInB, 
+                localHeight, bandInk, i)))
+                continue;
+            jobs[b * colorsNr + i] = new JBIGBandJob(&algo, page->arena(),
+                page->planeBuffer(i) + index, lineWidthInB, copyWidthInB,
+                bufferWidth, bandHeight, localHeight);
+            queue[jobsNr++] = jobs[b * colorsNr + i];
+        }
+    }
+
+    // Compress the bands and the colors at the same time
+    runJobs(queue, jobsNr);
+
+    // Register the bands in order
+    for (unsigned long b=0; b < bandsNr; b++) {
+        Band *current = NULL;
+
+        for (unsigned long i=0; i < colorsNr; i++) {
+            JBIGBandJob *job = jobs[b * colorsNr + i];
+            BandPlane *plane = job ? job->result() : NULL;
+
+            if (!plane)
+                continue;
+            plane->setColorNr((1 == colorsNr) ? 4 : i + 1);
+            if (!current)
+                current = new (page->arena()) Band(b, bufferWidth, 
+                    bandHeight);
+            current->registerPlane(plane);
+            // Every band has the same BIH
+            if (!page->getBIH())
+                page->setBIH(job->bih());
         }
         if (current)
             page->registerBand(current);
-        bandNumber++;
-        index += indexSizeIncrement;
-        pageHeight = theEnd ? 0 : pageHeight - bandHeight;
     }
-    if (page->bandsNr() > 0)
-        page->setBIH(algo->getBIHdata());
     page->flushPlanes();
-    for (unsigned int i=0; i < page->colorsNr(); i++)
-        delete[] band[i];
-    delete algo;
+    for (unsigned long i=0; i < jobsNr; i++)
+        delete queue[i];
+    delete[] jobs;
+    delete[] queue;
     return true;
 }
 
+/*
+ * Compression d'une couleur d'une page entière
+ * Compression of a whole page color
+ */
+class JBIGJob : public Job
+{
+    protected:
+        const Request*          _request;
+        Arena*                  _arena;
+        Algo0x13*               _algo;
+        const unsigned char*    _plane;
+        unsigned long           _lineWidthInB;
+        unsigned long           _width;
+        unsigned long           _linesNr;
+        unsigned long           _height;
+        bool                    _result;
+
+    public:
+        JBIGJob(const Request& request, Arena& arena, Algo0x13* algo, 
+            const unsigned char* plane, unsigned long lineWidthInB,
+            unsigned long width, unsigned long linesNr, unsigned long height);
+        virtual ~JBIGJob() {}
+
+    public:
+        virtual void            run();
+
+        bool                    result() const {return _result;}
+};
+
+JBIGJob::JBIGJob(const Request& request, Arena& arena, Algo0x13* algo, 
+    const unsigned char* plane, unsigned long lineWidthInB, 
+    unsigned long width, unsigned long linesNr, unsigned long height)
+{
+    _request = &request;
+    _arena = &arena;
+    _algo = algo;
+    _plane = plane;
+    _lineWidthInB = lineWidthInB;
+    _width = width;
+    _linesNr = linesNr;
+    _height = height;
+    _result = false;
+}
+
+void JBIGJob::run()
+{
+    _result = _algo->encode(*_request, _plane, _lineWidthInB, _width, _linesNr, 
+        _height, *_arena);
+}
+
 static bool _compressWholePage(const Request& request, Page* page)
 {
     unsigned long hardMarginX, hardMarginXInB, hardMarginY, lineWidthInB;
     unsigned long pageWidth, bandHeight, planeHeight, pageHeight, index;
     unsigned long bandNumber=0;
-    unsigned char *buffer;
     Band *current = NULL;
     Algo0x13 algo[4];
+    JBIGJob *jobs[4];
+    Job *queue[4];
+    bool encoded = true;
 
     hardMarginX = ((unsigned long)ceil(page->convertToXResolution(request.
         printer()->hardMarginX())) + 7) & ~7;
@@ -315,37 +878,50 @@ static bool _compressWholePage(const Request& request, Page* page)
     pageHeight = page->height() - hardMarginY * 2;
     page->setWidth(pageWidth);
     page->setHeight(pageHeight);
+
+    // A blank page has no bands
+    if (page->isBlank()) {
+        page->flushPlanes();
+        return true;
+    }
+
     lineWidthInB = (pageWidth + 7) / 8;
     bandHeight = request.printer()->bandHeight();
     // Alignment of the page height on band height
     planeHeight = ((pageHeight + bandHeight - 1) / bandHeight) * bandHeight;
-    buffer = new unsigned char[lineWidthInB * planeHeight];
+
+    // Encode the colors at the same time, directly from the page planes
+    index = hardMarginY * (lineWidthInB + 2 * hardMarginXInB) + 
+        hardMarginXInB;
+    for (unsigned int i=0; i < page->colorsNr(); i++) {
+        jobs[i] = new JBIGJob(request, page->arena(), &algo[i], 
+            page->planeBuffer(i) + index, lineWidthInB + 2 * hardMarginXInB,
+            pageWidth, pageHeight, planeHeight);
+        queue[i] = jobs[i];
+    }
+    runJobs(queue, page->colorsNr());
+    for (unsigned int i=0; i < page->colorsNr(); i++) {
+        if (!jobs[i]->result()) {
+            ERRORMSG(_("Cannot compress the color %u of the page"), i + 1);
+            encoded = false;
+        }
+        delete jobs[i];
+    }
+    if (!encoded) {
+        page->flushPlanes();
+        return false;
+    }
 
     do {
         current = NULL;
         for (unsigned int i=0; i < page->colorsNr(); i++) {
-            unsigned char *curPlane = page->planeBuffer(i);
-            BandPlane *plane;
-
-            index = hardMarginY * (lineWidthInB + 2 * hardMarginXInB) + 
-                hardMarginXInB;
-            for (unsigned int y=0; y < pageHeight; y++, 
-                    index += 2 * hardMarginXInB) {
-                for (unsigned int x=0; x < lineWidthInB; x++, index++) {
-                    buffer[x + y * lineWidthInB] = curPlane[index];
-                }
-            }
-            memset(buffer + pageHeight * lineWidthInB, 0,
-                   (planeHeight - pageHeight) * lineWidthInB);
+            BandPlane *plane = algo[i].nextPlane();
 
-            // Call the compression method
-            plane = algo[i].compress(request, buffer, page->width(), 
-                planeHeight);
             if (plane) {
                 plane->setColorNr(i + 1);
                 if (!current)
-                    current = new Band(bandNumber, page->width(), 
-                        request.printer()->bandHeight());
+                    current = new (page->arena()) Band(bandNumber, 
+                        page->width(), request.printer()->bandHeight());
                 current->registerPlane(plane);
             }
         }
@@ -355,12 +931,53 @@ static bool _compressWholePage(const Request& request, Page* page)
     } while (current);
 
     page->flushPlanes();
-    delete[] buffer;
 
     return true;
 }
 #endif /* DISABLE_JBIG */
 
+bool canStreamPage(const Request& request, const Page* page)
+{
+    // Even pages are rotated in the manual long edge duplex mode
+    if (request.duplex() == Request::ManualLongEdge && !(page->pageNr() % 2))
+        return false;
+
+    switch (page->compression()) {
+        case 0x0D:
+        case 0x0E:
+        case 0x11:
+            return true;
+    }
+    return false;
+}
+
+void prepareStreamedPage(const Request& request, Page* page)
+{
+    unsigned long hardMarginXInB, hardMarginY, bandHeight;
+
+    _computeBandedGeometry(request, page, hardMarginXInB, hardMarginY, 
+        bandHeight);
+    page->setHeight(page->height() - hardMarginY);
+
+    // The bitmap of the page is never loaded into memory
+    page->flushPlanes();
+}
+
+bool compressStreamedPage(const Request& request, Page* page,
+    Document& document)
+{
+    switch (page->compression()) {
+        case 0x0D:
+        case 0x0E:
+        case 0x11:
+            return _compressStreamedBandedPage(request, page, document);
+        default:
+            ERRORMSG(_("Compression algorithm 0x%lX cannot be streamed"), 
+                page->compression());
+    }
+    return false;
+}
+
 bool compressPage(const Request& request, Page* page)
 {
     switch(page->compression()) {
@@ -393,5 +1010,24 @@ bool compressPage(const Request& request, Page* page)
     return false;
 }
 
+void releaseEncoders()
+{
+    while (_freeContexts) {
+        EncoderContext *next = _freeContexts->next;
+
+        delete _freeContexts;
+        _freeContexts = next;
+    }
+}
+
+void reportCompressionStatistics()
+{
+    if (!_0x0DEncodedNr && !_0x0DPredictedNr && !_0x0DMispredictedNr)
+        return;
+    DEBUGMSG(_("Algorithm 0xd: %lu bands encoded, %lu bands predicted to be "
+        "unsuited, %lu unsuited bands not predicted"), _0x0DEncodedNr,
+        _0x0DPredictedNr, _0x0DMispredictedNr);
+}
+
 /* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
 
@@ -24,6 +24,10 @@
 #include "page.h"
 #include "errlog.h"
 #include "request.h"
+#include "colors.h"
+#include "kernels.h"
+#include "planepool.h"
+#include "compress.h"
 
 /*
  * Constructeur - Destructeur
@@ -32,10 +36,15 @@
 Document::Document()
 {
     _raster = NULL;
+    _line = NULL;
+    _streaming = false;
+    _rotate = false;
 }
 
 Document::~Document()
 {
+    if (_line)
+        delete[] _line;
     if (_raster)
          cupsRasterClose(_raster);
 }
@@ -61,17 +70,14 @@ bool Document::load(const Request& request)
 
 
 /*
- * Extraction d'une nouvelle page de la requête
- * Exact a new job page
+ * Lecture de l'entête d'une page
+ * Read the header of a page
  */
-Page* Document::getNextRawPage(const Request& request)
+Page* Document::_readPageHeader(const Request& request)
 {
     cups_page_header_t header;
-    unsigned long pageWidth, pageWidthInB, pageHeight, clippingX=0, clippingY=0;
-    unsigned long documentWidth, documentHeight, lineSize, planeSize, index=0;
-    unsigned long bytesToCopy, marginWidthInB=0, marginHeight=0;
-    unsigned char *line, *planes[4];
-    unsigned char colors;
+    unsigned long pageWidth, clippingY=0, documentWidth, documentHeight;
+    unsigned long marginHeight=0;
     Page *page;
 
     // Read the header
@@ -92,111 +98,307 @@ Page* Document::getNextRawPage(const Request& request)
     page = new Page;
     page->setXResolution(header.HWResolution[0]);
     page->setYResolution(header.HWResolution[1]);
-    colors = header.cupsColorSpace == CUPS_CSPACE_K ? 1 : 4;
+    _colors = header.cupsColorSpace == CUPS_CSPACE_K ? 1 : 4;
     documentWidth = (header.cupsWidth + 7) & ~7;
     documentHeight = header.cupsHeight;
-    lineSize = header.cupsBytesPerLine / colors;
+    _lineSize = header.cupsBytesPerLine / _colors;
     pageWidth = ((unsigned long)ceil(page->convertToXResolution(request.
         printer()->pageWidth())) + 7) & ~7;
-    pageHeight = ceil(page->convertToYResolution(request.printer()->
+    _pageHeight = ceil(page->convertToYResolution(request.printer()->
         pageHeight()));
-    marginWidthInB =(ceil(page->convertToXResolution(header.Margins[0]))+7)/8; 
+    _marginWidthInB =(ceil(page->convertToXResolution(header.Margins[0]))+7)/8; 
     marginHeight = ceil(page->convertToYResolution(header.Margins[1]));
-    pageWidthInB = (pageWidth + 7) / 8;
-    planeSize = pageWidthInB * pageHeight;
+    _pageWidthInB = (pageWidth + 7) / 8;
     page->setWidth(pageWidth);
-    page->setHeight(pageHeight);
-    page->setColorsNr(colors);
+    page->setHeight(_pageHeight);
+    page->setColorsNr(_colors);
     page->setPageNr(_currentPage);
     page->setCompression(header.cupsCompression);
     page->setCopiesNr(header.NumCopies);
 
     // Calculate clippings and margins
-    if (lineSize > pageWidthInB - 2 * marginWidthInB) {
-        clippingX = (lineSize - (pageWidthInB - 2 * marginWidthInB)) / 2;
-        bytesToCopy = pageWidthInB - 2 * marginWidthInB;
+    if (_lineSize > _pageWidthInB - 2 * _marginWidthInB) {
+        _clippingX = (_lineSize - (_pageWidthInB - 2 * _marginWidthInB)) / 2;
+        _bytesToCopy = _pageWidthInB - 2 * _marginWidthInB;
     } else {
-        clippingX = 0;
-        marginWidthInB = (pageWidthInB - lineSize) / 2;
-        bytesToCopy = lineSize;
+        _clippingX = 0;
+        _marginWidthInB = (_pageWidthInB - _lineSize) / 2;
+        _bytesToCopy = _lineSize;
     }
 
-    if (documentHeight > pageHeight - 2 * marginHeight) {
-        clippingY = (documentHeight - (pageHeight - 2 * marginHeight)) / 2;
-        index = pageWidthInB * marginHeight;
+    if (documentHeight > _pageHeight - 2 * marginHeight) {
+        clippingY = (documentHeight - (_pageHeight - 2 * marginHeight)) / 2;
+        _firstLine = marginHeight;
     } else {
         clippingY = 0;
-        index = pageWidthInB * ((pageHeight - documentHeight)/2);
+        _firstLine = (_pageHeight - documentHeight) / 2;
     }
     documentHeight -= clippingY;
-    pageHeight -= 2*marginHeight;
-    clippingY *= colors;
-    line = new unsigned char[header.cupsBytesPerLine];
+    _linesToCopy = _pageHeight - 2 * marginHeight;
+    if (_linesToCopy > documentHeight)
+        _linesToCopy = documentHeight;
+    _linesToSkip = documentHeight - _linesToCopy;
+    _currentLine = 0;
+    _line = new unsigned char[header.cupsBytesPerLine];
     DEBUGMSG(_("Document width=%lu height=%lu"), documentWidth, documentHeight);
-    DEBUGMSG(_("Page width=%lu (%lu) height=%lu"), pageWidth, pageWidthInB, pageHeight);
-    DEBUGMSG(_("Margin width in bytes=%lu height=%lu"), marginWidthInB, marginHeight);
-    DEBUGMSG(_("Clipping X=%lu Y=%lu"), clippingX, clippingY);
-    DEBUGMSG(_("Line size=%lu, Plane size=%lu, bytes to copy=%lu"), lineSize, planeSize, bytesToCopy);
-
-    // Prepare planes and clip vertically the document if needed
-    for (unsigned char i=0; i < colors; i++) {
-        planes[i] = new unsigned char[planeSize];
-        memset(planes[i], 0, planeSize);
-    }
-    while (clippingY) {
-        if (cupsRasterReadPixels(_raster, line, lineSize) < 1) {
+    DEBUGMSG(_("Page width=%lu (%lu) height=%lu"), pageWidth, _pageWidthInB,
+        _pageHeight);
+    DEBUGMSG(_("Margin width in bytes=%lu height=%lu"), _marginWidthInB,
+        marginHeight);
+    DEBUGMSG(_("Clipping X=%lu Y=%lu"), _clippingX, clippingY);
+    DEBUGMSG(_("Line size=%lu, bytes to copy=%lu"), _lineSize, _bytesToCopy);
+
+    // Clip vertically the document if needed
+    if (!_skipRasterLines(clippingY)) {
+        _closePage();
+        delete page;
+        return NULL;
+    }
+
+    return page;
+}
+
+bool Document::_skipRasterLines(unsigned long nr)
+{
+    for (nr *= _colors; nr; nr--) {
+        if (cupsRasterReadPixels(_raster, _line, _lineSize) < 1) {
             ERRORMSG(_("Cannot read pixel line"));
-            for (unsigned int i=0; i < colors; i++)
-                delete[] planes[i];
-            delete[] line;
-            delete page;
-            return NULL;
+            _lastPage = true;
+            return false;
         }
-        clippingY--;
     }
+    return true;
+}
 
-    // Load the bitmap
-    while (pageHeight && documentHeight) {
-        for (unsigned int i=0; i < colors; i++) {
-            if (cupsRasterReadPixels(_raster, line, lineSize) < 1) {
+void Document::_closePage()
+{
+    delete[] _line;
+    _line = NULL;
+    _streaming = false;
+    _rotate = false;
+}
+
+
+
+/*
+ * Lecture des lignes de la page courante
+ * Read the lines of the current page
+ */
+bool Document::readLines(unsigned char** planes, unsigned long nr,
+    unsigned char* ink)
+{
+    unsigned long row;
+
+    if (!_line || _currentLine + nr > _pageHeight) {
+        ERRORMSG(_("Cannot read lines outside of the current page"));
+        return false;
+    }
+
+    /*
+     * A rotated page is written from the bottom to the top and each line is
+     * reversed bit by bit, which makes a 180° rotation of the bitmap.
+     */
+    for (unsigned long i=0; i < nr; i++, _currentLine++) {
+        unsigned char *lines[4];
+
+        row = _rotate ? nr - i - 1 : i;
+        for (unsigned int j=0; j < _colors; j++)
+            lines[j] = planes[j] + row * _pageWidthInB;
+        if (ink)
+            ink[row] = 0;
+
+        // Lines outside of the raster page
+        if (_currentLine < _firstLine || _currentLine >= _firstLine + 
+            _linesToCopy) {
+            for (unsigned int j=0; j < _colors; j++)
+                memset(lines[j], 0, _pageWidthInB);
+            continue;
+        }
+
+        for (unsigned int j=0; j < _colors; j++) {
+            if (cupsRasterReadPixels(_raster, _line, _lineSize) < 1) {
                 ERRORMSG(_("Cannot read pixel line"));
-                for (unsigned int j=0; j < colors; j++)
-                    delete[] planes[j];
-                delete[] line;
-                delete page;
-                return NULL;
+                _lastPage = true;
+                _closePage();
+                return false;
             }
-            memcpy(planes[i] + index + marginWidthInB, line + clippingX, 
-                bytesToCopy);
+            memset(lines[j], 0, _marginWidthInB);
+            memcpy(lines[j] + _marginWidthInB, _line + _clippingX, 
+                _bytesToCopy);
+            memset(lines[j] + _marginWidthInB + _bytesToCopy, 0, 
+                _pageWidthInB - _marginWidthInB - _bytesToCopy);
+        }
+
+        // Process the line while it is still in the cache
+#ifndef DISABLE_BLACKOPTIM
+        if (_colors == 4) {
+            unsigned char *printed[4];
+
+            for (unsigned int j=0; j < 4; j++)
+                printed[j] = lines[j] + _marginWidthInB;
+            applyBlackOptimization(printed, _bytesToCopy);
+        }
+#endif /* DISABLE_BLACKOPTIM */
+        for (unsigned int j=0; j < _colors; j++) {
+            if (ink && !isBlankBuffer(lines[j] + _marginWidthInB, 
+                _bytesToCopy, 0))
+                ink[row] |= 1 << j;
+            if (_rotate)
+                reverseBuffer(lines[j], _pageWidthInB);
         }
-        index += pageWidthInB;
-        pageHeight--;
-        documentHeight--;
     }
 
     // Finish to clip vertically the document
-    documentHeight *= colors;
-    while (documentHeight) {
-        if (cupsRasterReadPixels(_raster, line, lineSize) < 1) {
-            ERRORMSG(_("Cannot read pixel line"));
-            for (unsigned int j=0; j < colors; j++)
-                delete[] planes[j];
-            delete[] line;
-            delete page;
-            return NULL;
+    if (_currentLine == _pageHeight) {
+        bool res = _skipRasterLines(_linesToSkip);
+
+        _closePage();
+        return res;
+    }
+    return true;
+}
+
+
+
+/*
+ * Chargement des plans de la page courante
+ * Load the planes of the current page
+ */
+bool Document::_loadPlanes(unsigned char** planes, unsigned char* ink)
+{
+    unsigned long planeSize, row, nr;
+    unsigned char *lines[4], *rest[4], *buffer;
+    bool res = true;
+
+    /*
+     * Les lignes sont lues une à une tant qu'elles sont blanches. Les plans
+     * ne sont alloués qu'à la première ligne encrée, les lignes précédentes
+     * sont alors effacées et la suite de la page est lue directement dans
+     * les plans.
+     * Lines are read one by one while they are blank. The planes are only
+     * allocated at the first inked line, the previous lines are then cleared
+     * and the rest of the page is directly read into the planes.
+     */
+    planeSize = _pageWidthInB * _pageHeight;
+    buffer = new unsigned char[_colors * _pageWidthInB];
+    for (unsigned int i=0; i < _colors; i++) {
+        planes[i] = NULL;
+        lines[i] = buffer + i * _pageWidthInB;
+    }
+    for (nr=0; nr < _pageHeight; nr++) {
+        row = _rotate ? _pageHeight - nr - 1 : nr;
+        if (!(res = readLines(lines, 1, ink + row)))
+            break;
+        if (!ink[row])
+            continue;
+
+        for (unsigned int i=0; i < _colors; i++) {
+            if (!(planes[i] = allocatePlane(planeSize))) {
+                ERRORMSG(_("Cannot allocate the planes of the page"));
+                _lastPage = true;
+                _closePage();
+                res = false;
+                break;
+            }
+            memcpy(planes[i] + row * _pageWidthInB, lines[i], _pageWidthInB);
+            if (_rotate) {
+                memset(planes[i] + (row + 1) * _pageWidthInB, 0, 
+                    nr * _pageWidthInB);
+                rest[i] = planes[i];
+            } else {
+                memset(planes[i], 0, nr * _pageWidthInB);
+                rest[i] = planes[i] + (nr + 1) * _pageWidthInB;
+            }
         }
-        documentHeight--;
+        if (res && nr + 1 < _pageHeight)
+            res = readLines(rest, _pageHeight - nr - 1, _rotate ? ink : 
+                ink + nr + 1);
+        break;
+    }
+    delete[] buffer;
+
+    return res;
+}
+
+
+
+/*
+ * Extraction d'une nouvelle page de la requête
+ * Exact a new job page
+ */
+Page* Document::getNextRawPage(const Request& request)
+{
+    unsigned char *planes[4], *ink, inked=0, colors;
+    Page *page;
+
+    if (_line) {
+        ERRORMSG(_("The previous page hasn't been entirely read"));
+        return NULL;
+    }
+    if (!(page = _readPageHeader(request)))
+        return NULL;
+
+    // Streamed pages are read later band by band
+    if (canStreamPage(request, page)) {
+        _streaming = true;
+        _currentPage++;
+        DEBUGMSG(_("Page %lu (%lu×%lu) will be streamed"), page->pageNr(), 
+            page->width(), page->height());
+        return page;
+    }
+
+    // Make rotation on even pages for ManualLongEdge duplex mode
+    _rotate = request.duplex() == Request::ManualLongEdge && 
+        !(page->pageNr() % 2);
+
+    // Load the bitmap
+    ink = new unsigned char[_pageHeight];
+    if (!_loadPlanes(planes, ink)) {
+        for (unsigned int i=0; i < _colors; i++)
+            releasePlane(planes[i]);
+        delete[] ink;
+        delete page;
+        return NULL;
     }
     _currentPage++;
 
+    // Blank pages keep no planes
+    if (!planes[0]) {
+        delete[] ink;
+        page->setBlank();
+        DEBUGMSG(_("Page %lu (%lu×%lu) is blank"), page->pageNr(), 
+            page->width(), page->height());
+        return page;
+    }
+
+    /*
+     * Une page couleur sans cyan, magenta ni jaune est réduite à son plan
+     * noir, comme une page monochrome.
+     * A color page without cyan, magenta or yellow is demoted to its black
+     * plane, like a monochrome page.
+     */
+    colors = _colors;
+    for (unsigned long i=0; i < _pageHeight; i++)
+        inked |= ink[i];
+    if (colors == 4 && !(inked & 0x7)) {
+        for (unsigned int i=0; i < 3; i++)
+            releasePlane(planes[i]);
+        planes[0] = planes[3];
+        for (unsigned long i=0; i < _pageHeight; i++)
+            ink[i] >>= 3;
+        colors = 1;
+        page->setColorsNr(colors);
+        DEBUGMSG(_("Page %lu has no colors and is printed in black"), 
+            page->pageNr());
+    }
+
     for (unsigned int i=0; i < colors; i++)
         page->setPlaneBuffer(i, planes[i]);
+    page->setInkLines(ink);
 
-    DEBUGMSG(_("Page %lu (%u×%u on %lu×%lu) has been successfully loaded into "
-        "memory"), page->pageNr(), header.cupsWidth, header.cupsHeight, 
-        page->width(), page->height());
+    DEBUGMSG(_("Page %lu (%lu×%lu) has been successfully loaded into "
+        "memory"), page->pageNr(), page->width(), page->height());
 
-    delete[] line;
     return page;
 }
 
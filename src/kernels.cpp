@@ -0,0 +1,568 @@
+/*
+ * 	    kernels.cpp               (C) 2008, Aurélien Croc (AP²C)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the
+ *  Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ *  $Id$
+ * 
+ */
+#include "kernels.h"
+#include <string.h>
+#include "errlog.h"
+
+/*
+ * The SIMD kernels are compiled with the target attribute and selected at
+ * run time, so that a generic build uses the best instructions of the CPU.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    ((defined(__GNUC__) && __GNUC__ >= 6) || defined(__clang__))
+#define KERNELS_X86
+#include <immintrin.h>
+
+#define TARGET_SSE2             __attribute__((target("sse2")))
+#define TARGET_AVX2             __attribute__((target("avx2")))
+#define TARGET_AVX512           __attribute__((target("avx512f,avx512bw")))
+#endif /* x86 */
+
+
+
+/*
+ * Implémentations portables
+ * Portable implementations
+ */
+/*
+ * The buffers are not aligned on words, as the printed part of a line starts
+ * after its margin. Words are copied with memcpy(), which the compiler turns
+ * into a single load or store where unaligned accesses are allowed.
+ */
+static inline unsigned long _loadWord(const unsigned char* data)
+{
+    unsigned long word;
+
+    memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+static inline void _storeWord(unsigned char* data, unsigned long word)
+{
+    memcpy(data, &word, sizeof(word));
+}
+
+static bool _isBlankScalar(const unsigned char* data, unsigned long size,
+    unsigned char blank)
+{
+    unsigned long max, mod, blanks = blank ? ~0UL : 0;
+
+    max = size / sizeof(unsigned long);
+    mod = size % sizeof(unsigned long);
+
+    for (unsigned long i=0; i < max; i++) {
+        if (_loadWord(data + i * sizeof(unsigned long)) != blanks)
+            return false;
+    }
+    for (unsigned long i=0; i < mod; i++)
+        if (data[size-i-1] != blank)
+            return false;
+    return true;
+}
+
+static inline unsigned char _reverseBits(unsigned char b)
+{
+    b = (b >> 4) | (b << 4);
+    b = ((b & 0xCC) >> 2) | ((b & 0x33) << 2);
+    return ((b & 0xAA) >> 1) | ((b & 0x55) << 1);
+}
+
+static void _reverseScalar(unsigned char* data, unsigned long size)
+{
+    unsigned long i, j;
+    unsigned char tmp;
+
+    for (i=0, j=size; i + 1 < j; i++, j--) {
+        tmp = data[i];
+        data[i] = _reverseBits(data[j - 1]);
+        data[j - 1] = _reverseBits(tmp);
+    }
+
+    // The middle byte of an odd buffer stays at its place
+    if (i + 1 == j)
+        data[i] = _reverseBits(data[i]);
+}
+
+static void _optimizeBlackScalar(unsigned char* planes[4], unsigned long size)
+{
+    unsigned long sizeByUL, mod, mask;
+    unsigned char bmask;
+
+    sizeByUL = size / sizeof(unsigned long);
+    mod = size % sizeof(unsigned long);
+
+
+    /*
+     * To optimize this algorithm, data are first evaluated by unsigned long
+     * (32-Bits on 32-Bits architecture and 64-Bits on 64-Bits architecture).
+     * The last bytes are evaluated individually if the size is not a multiple
+     * of the size of the unsigned long
+     */
+    for (unsigned long i=0; i < sizeByUL; i++) {
+        unsigned long offset = i * sizeof(unsigned long), c, m, y, k;
+
+        // Nothing to do without colored dots
+        c = _loadWord(planes[0] + offset);
+        m = _loadWord(planes[1] + offset);
+        y = _loadWord(planes[2] + offset);
+        if (!(c | m | y))
+            continue;
+
+        // Clear cyan, magenta and yellow dots if a black dot is present
+        k = _loadWord(planes[3] + offset);
+        c &= ~k;
+        m &= ~k;
+        y &= ~k;
+
+        // Set a black dot if cyan, magenta and yellow dots are present and
+        // clear them
+        mask = c & m & y;
+        _storeWord(planes[0] + offset, c & ~mask);
+        _storeWord(planes[1] + offset, m & ~mask);
+        _storeWord(planes[2] + offset, y & ~mask);
+        _storeWord(planes[3] + offset, k | mask);
+    }
+
+    for (unsigned long i=1; i <= mod; i++) {
+        // Clear cyan, magenta and yellow dots if a black dot is present
+        bmask = planes[3][size - i];
+        if (bmask) {
+            planes[0][size - i] &= ~bmask;
+            planes[1][size - i] &= ~bmask;
+            planes[2][size - i] &= ~bmask;
+        }
+
+        // Set a black dot if cyan, magenta and yellow dots are present and
+        // clear them
+        bmask = planes[0][size - i];
+        bmask &= planes[1][size - i];
+        bmask &= planes[2][size - i];
+        if (bmask) {
+            planes[3][size - i] |= bmask;
+            planes[0][size - i] &= ~bmask;
+            planes[1][size - i] &= ~bmask;
+            planes[2][size - i] &= ~bmask;
+        }
+    }
+}
+
+/*
+ * The SIMD kernels process the beginning of the buffers by vectors and call
+ * the portable ones for the remaining bytes.
+ */
+static void _optimizeBlackTail(unsigned char* planes[4], unsigned long done, 
+    unsigned long size)
+{
+    unsigned char *tail[4];
+
+    for (unsigned int j=0; j < 4; j++)
+        tail[j] = planes[j] + done;
+    _optimizeBlackScalar(tail, size - done);
+}
+
+
+
+#ifdef KERNELS_X86
+/*
+ * Implémentations SSE2
+ * SSE2 implementations
+ */
+TARGET_SSE2 static bool _isBlankSSE2(const unsigned char* data, 
+    unsigned long size, unsigned char blank)
+{
+    const __m128i blanks = _mm_set1_epi8((char)blank);
+    const __m128i zero = _mm_setzero_si128();
+    unsigned long i;
+
+    for (i=0; i + 64 <= size; i += 64) {
+        const __m128i *p = (const __m128i *)(data + i);
+        __m128i diff;
+
+        diff = _mm_or_si128(
+            _mm_or_si128(_mm_xor_si128(_mm_loadu_si128(p), blanks),
+                _mm_xor_si128(_mm_loadu_si128(p + 1), blanks)),
+            _mm_or_si128(_mm_xor_si128(_mm_loadu_si128(p + 2), blanks),
+                _mm_xor_si128(_mm_loadu_si128(p + 3), blanks)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, zero)) != 0xFFFF)
+            return false;
+    }
+    return _isBlankScalar(data + i, size - i, blank);
+}
+
+TARGET_SSE2 static inline __m128i _reverseSSE2(__m128i v)
+{
+    const __m128i m0F = _mm_set1_epi8(0x0F);
+    const __m128i m33 = _mm_set1_epi8(0x33);
+    const __m128i m55 = _mm_set1_epi8(0x55);
+
+    // Reverse the bits of each byte by swapping nibbles, pairs and bits
+    v = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, m0F), 4),
+        _mm_and_si128(_mm_srli_epi16(v, 4), m0F));
+    v = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, m33), 2),
+        _mm_and_si128(_mm_srli_epi16(v, 2), m33));
+    v = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(v, m55), 1),
+        _mm_and_si128(_mm_srli_epi16(v, 1), m55));
+
+    // Reverse the bytes: dwords, then words, then the bytes of each word
+    v = _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+TARGET_SSE2 static void _reverseBufferSSE2(unsigned char* data, 
+    unsigned long size)
+{
+    unsigned long i = 0, j = size;
+
+    // Swap a vector of the beginning with a vector of the end
+    for (; i + 32 <= j; i += 16, j -= 16) {
+        __m128i head = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i tail = _mm_loadu_si128((const __m128i *)(data + j - 16));
+
+        _mm_storeu_si128((__m128i *)(data + i), _reverseSSE2(tail));
+        _mm_storeu_si128((__m128i *)(data + j - 16), _reverseSSE2(head));
+    }
+    _reverseScalar(data + i, j - i);
+}
+
+TARGET_SSE2 static void _optimizeBlackSSE2(unsigned char* planes[4], 
+    unsigned long size)
+{
+    const __m128i zero = _mm_setzero_si128();
+    unsigned long i;
+
+    for (i=0; i + 16 <= size; i += 16) {
+        __m128i c, m, y, k, mask;
+
+        c = _mm_loadu_si128((const __m128i *)(planes[0] + i));
+        m = _mm_loadu_si128((const __m128i *)(planes[1] + i));
+        y = _mm_loadu_si128((const __m128i *)(planes[2] + i));
+
+        // Nothing to do without colored dots
+        mask = _mm_or_si128(_mm_or_si128(c, m), y);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(mask, zero)) == 0xFFFF)
+            continue;
+        k = _mm_loadu_si128((const __m128i *)(planes[3] + i));
+        c = _mm_andnot_si128(k, c);
+        m = _mm_andnot_si128(k, m);
+        y = _mm_andnot_si128(k, y);
+        mask = _mm_and_si128(_mm_and_si128(c, m), y);
+        _mm_storeu_si128((__m128i *)(planes[0] + i), 
+            _mm_andnot_si128(mask, c));
+        _mm_storeu_si128((__m128i *)(planes[1] + i), 
+            _mm_andnot_si128(mask, m));
+        _mm_storeu_si128((__m128i *)(planes[2] + i), 
+            _mm_andnot_si128(mask, y));
+        _mm_storeu_si128((__m128i *)(planes[3] + i), _mm_or_si128(k, mask));
+    }
+    _optimizeBlackTail(planes, i, size);
+}
+
+
+
+/*
+ * Implémentations AVX2
+ * AVX2 implementations
+ */
+TARGET_AVX2 static bool _isBlankAVX2(const unsigned char* data, 
+    unsigned long size, unsigned char blank)
+{
+    const __m256i blanks = _mm256_set1_epi8((char)blank);
+    unsigned long i;
+
+    for (i=0; i + 128 <= size; i += 128) {
+        const __m256i *p = (const __m256i *)(data + i);
+        __m256i diff;
+
+        diff = _mm256_or_si256(
+            _mm256_or_si256(_mm256_xor_si256(_mm256_loadu_si256(p), blanks),
+                _mm256_xor_si256(_mm256_loadu_si256(p + 1), blanks)),
+            _mm256_or_si256(_mm256_xor_si256(_mm256_loadu_si256(p + 2), 
+                blanks), _mm256_xor_si256(_mm256_loadu_si256(p + 3), blanks)));
+        if (!_mm256_testz_si256(diff, diff))
+            return false;
+    }
+    return _isBlankScalar(data + i, size - i, blank);
+}
+
+TARGET_AVX2 static inline __m256i _reverseAVX2(__m256i v)
+{
+    // Reversed nibbles, shifted or not to the high nibble
+    const __m256i lowLut = _mm256_setr_epi8(
+        0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0,
+        0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0,
+        0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0,
+        0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0);
+    const __m256i highLut = _mm256_setr_epi8(
+        0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE,
+        0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF,
+        0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE,
+        0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF);
+    const __m256i bytes = _mm256_setr_epi8(
+        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    const __m256i m0F = _mm256_set1_epi8(0x0F);
+
+    v = _mm256_or_si256(_mm256_shuffle_epi8(lowLut, _mm256_and_si256(v, m0F)),
+        _mm256_shuffle_epi8(highLut, _mm256_and_si256(_mm256_srli_epi16(v, 4),
+        m0F)));
+    v = _mm256_shuffle_epi8(v, bytes);
+    return _mm256_permute2x128_si256(v, v, 1);
+}
+
+TARGET_AVX2 static void _reverseBufferAVX2(unsigned char* data, 
+    unsigned long size)
+{
+    unsigned long i = 0, j = size;
+
+    for (; i + 64 <= j; i += 32, j -= 32) {
+        __m256i head = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i tail = _mm256_loadu_si256((const __m256i *)(data + j - 32));
+
+        _mm256_storeu_si256((__m256i *)(data + i), _reverseAVX2(tail));
+        _mm256_storeu_si256((__m256i *)(data + j - 32), _reverseAVX2(head));
+    }
+    _reverseScalar(data + i, j - i);
+}
+
+TARGET_AVX2 static void _optimizeBlackAVX2(unsigned char* planes[4], 
+    unsigned long size)
+{
+    unsigned long i;
+
+    for (i=0; i + 32 <= size; i += 32) {
+        __m256i c, m, y, k, mask;
+
+        c = _mm256_loadu_si256((const __m256i *)(planes[0] + i));
+        m = _mm256_loadu_si256((const __m256i *)(planes[1] + i));
+        y = _mm256_loadu_si256((const __m256i *)(planes[2] + i));
+
+        // Nothing to do without colored dots
+        mask = _mm256_or_si256(_mm256_or_si256(c, m), y);
+        if (_mm256_testz_si256(mask, mask))
+            continue;
+        k = _mm256_loadu_si256((const __m256i *)(planes[3] + i));
+        c = _mm256_andnot_si256(k, c);
+        m = _mm256_andnot_si256(k, m);
+        y = _mm256_andnot_si256(k, y);
+        mask = _mm256_and_si256(_mm256_and_si256(c, m), y);
+        _mm256_storeu_si256((__m256i *)(planes[0] + i), 
+            _mm256_andnot_si256(mask, c));
+        _mm256_storeu_si256((__m256i *)(planes[1] + i), 
+            _mm256_andnot_si256(mask, m));
+        _mm256_storeu_si256((__m256i *)(planes[2] + i), 
+            _mm256_andnot_si256(mask, y));
+        _mm256_storeu_si256((__m256i *)(planes[3] + i), 
+            _mm256_or_si256(k, mask));
+    }
+    _optimizeBlackTail(planes, i, size);
+}
+
+
+
+/*
+ * Implémentations AVX-512
+ * AVX-512 implementations
+ *
+ * The zero-masked forms of the intrinsics are used with a full mask because
+ * the plain ones raise false uninitialized warnings with some GCC versions.
+ */
+#define ALL_LANES               (-1)
+
+TARGET_AVX512 static bool _isBlankAVX512(const unsigned char* data, 
+    unsigned long size, unsigned char blank)
+{
+    const __m512i blanks = _mm512_set1_epi8((char)blank);
+    unsigned long i;
+
+    for (i=0; i + 256 <= size; i += 256) {
+        const __m512i *p = (const __m512i *)(data + i);
+        __m512i diff;
+
+        diff = _mm512_or_si512(
+            _mm512_or_si512(_mm512_xor_si512(_mm512_loadu_si512(p), blanks),
+                _mm512_xor_si512(_mm512_loadu_si512(p + 1), blanks)),
+            _mm512_or_si512(_mm512_xor_si512(_mm512_loadu_si512(p + 2), 
+                blanks), _mm512_xor_si512(_mm512_loadu_si512(p + 3), blanks)));
+        if (_mm512_test_epi64_mask(diff, diff))
+            return false;
+    }
+    return _isBlankScalar(data + i, size - i, blank);
+}
+
+TARGET_AVX512 static inline __m512i _reverseAVX512(__m512i v)
+{
+    // Reversed nibbles, shifted or not to the high nibble
+    const __m512i lowLut = _mm512_maskz_broadcast_i32x4(ALL_LANES, 
+        _mm_setr_epi8(0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0,
+        0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0));
+    const __m512i highLut = _mm512_maskz_broadcast_i32x4(ALL_LANES, 
+        _mm_setr_epi8(0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE,
+        0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF));
+    const __m512i bytes = _mm512_maskz_broadcast_i32x4(ALL_LANES, 
+        _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0));
+    const __m512i m0F = _mm512_set1_epi8(0x0F);
+
+    v = _mm512_or_si512(_mm512_shuffle_epi8(lowLut, _mm512_and_si512(v, m0F)),
+        _mm512_shuffle_epi8(highLut, _mm512_and_si512(_mm512_srli_epi16(v, 4),
+        m0F)));
+    v = _mm512_shuffle_epi8(v, bytes);
+    return _mm512_maskz_shuffle_i64x2(ALL_LANES, v, v, 
+        _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+TARGET_AVX512 static void _reverseBufferAVX512(unsigned char* data, 
+    unsigned long size)
+{
+    unsigned long i = 0, j = size;
+
+    for (; i + 128 <= j; i += 64, j -= 64) {
+        __m512i head = _mm512_loadu_si512((const void *)(data + i));
+        __m512i tail = _mm512_loadu_si512((const void *)(data + j - 64));
+
+        _mm512_storeu_si512((void *)(data + i), _reverseAVX512(tail));
+        _mm512_storeu_si512((void *)(data + j - 64), _reverseAVX512(head));
+    }
+    _reverseScalar(data + i, j - i);
+}
+
+TARGET_AVX512 static void _optimizeBlackAVX512(unsigned char* planes[4], 
+    unsigned long size)
+{
+    unsigned long i;
+
+    for (i=0; i + 64 <= size; i += 64) {
+        __m512i c, m, y, k, mask;
+
+        c = _mm512_loadu_si512((const void *)(planes[0] + i));
+        m = _mm512_loadu_si512((const void *)(planes[1] + i));
+        y = _mm512_loadu_si512((const void *)(planes[2] + i));
+
+        // Nothing to do without colored dots
+        mask = _mm512_or_si512(_mm512_or_si512(c, m), y);
+        if (!_mm512_test_epi64_mask(mask, mask))
+            continue;
+        k = _mm512_loadu_si512((const void *)(planes[3] + i));
+        c = _mm512_maskz_andnot_epi64(ALL_LANES, k, c);
+        m = _mm512_maskz_andnot_epi64(ALL_LANES, k, m);
+        y = _mm512_maskz_andnot_epi64(ALL_LANES, k, y);
+        mask = _mm512_and_si512(_mm512_and_si512(c, m), y);
+        _mm512_storeu_si512((void *)(planes[0] + i), 
+            _mm512_maskz_andnot_epi64(ALL_LANES, mask, c));
+        _mm512_storeu_si512((void *)(planes[1] + i), 
+            _mm512_maskz_andnot_epi64(ALL_LANES, mask, m));
+        _mm512_storeu_si512((void *)(planes[2] + i), 
+            _mm512_maskz_andnot_epi64(ALL_LANES, mask, y));
+        _mm512_storeu_si512((void *)(planes[3] + i), 
+            _mm512_or_si512(k, mask));
+    }
+    _optimizeBlackTail(planes, i, size);
+}
+#endif /* KERNELS_X86 */
+
+
+
+/*
+ * Sélection des implémentations
+ * Implementations selection
+ */
+static bool (*_isBlank)(const unsigned char*, unsigned long, unsigned char) =
+    _isBlankScalar;
+static void (*_reverseBuffer)(unsigned char*, unsigned long) = _reverseScalar;
+static void (*_optimizeBlack)(unsigned char**, unsigned long) = 
+    _optimizeBlackScalar;
+static const char* _kernelsName = "portable";
+
+bool selectKernels(const char* name)
+{
+    if (!strcmp(name, "portable")) {
+        _isBlank = _isBlankScalar;
+        _reverseBuffer = _reverseScalar;
+        _optimizeBlack = _optimizeBlackScalar;
+        _kernelsName = "portable";
+        return true;
+    }
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if (!strcmp(name, "AVX-512") && __builtin_cpu_supports("avx512f") && 
+        __builtin_cpu_supports("avx512bw")) {
+        _isBlank = _isBlankAVX512;
+        _reverseBuffer = _reverseBufferAVX512;
+        _optimizeBlack = _optimizeBlackAVX512;
+        _kernelsName = "AVX-512";
+        return true;
+    }
+    if (!strcmp(name, "AVX2") && __builtin_cpu_supports("avx2")) {
+        _isBlank = _isBlankAVX2;
+        _reverseBuffer = _reverseBufferAVX2;
+        _optimizeBlack = _optimizeBlackAVX2;
+        _kernelsName = "AVX2";
+        return true;
+    }
+    if (!strcmp(name, "SSE2") && __builtin_cpu_supports("sse2")) {
+        _isBlank = _isBlankSSE2;
+        _reverseBuffer = _reverseBufferSSE2;
+        _optimizeBlack = _optimizeBlackSSE2;
+        _kernelsName = "SSE2";
+        return true;
+    }
+#endif /* KERNELS_X86 */
+    return false;
+}
+
+void initializeKernels()
+{
+    if (!selectKernels("AVX-512") && !selectKernels("AVX2") && 
+        !selectKernels("SSE2"))
+        selectKernels("portable");
+    DEBUGMSG(_("Kernels use the %s instructions"), _kernelsName);
+}
+
+const char* kernelsName()
+{
+    return _kernelsName;
+}
+
+
+
+/*
+ * Noyaux
+ * Kernels
+ */
+bool isBlankBuffer(const unsigned char* data, unsigned long size, 
+    unsigned char blank)
+{
+    return _isBlank(data, size, blank);
+}
+
+void reverseBuffer(unsigned char* data, unsigned long size)
+{
+    _reverseBuffer(data, size);
+}
+
+void optimizeBlack(unsigned char* planes[4], unsigned long size)
+{
+    _optimizeBlack(planes, size);
+}
+
+/* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
+
@@ -0,0 +1,282 @@
+/*
+ * 	    output.cpp                (C) 2008, Aurélien Croc (AP²C)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the
+ *  Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ *  $Id$
+ * 
+ */
+#include "output.h"
+#include <stdio.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#ifndef DISABLE_THREADS
+#include <pthread.h>
+#endif /* DISABLE_THREADS */
+#include "errlog.h"
+
+/*
+ * Tampons de sortie
+ * Output buffers
+ *
+ * The buffers are used as a ring. The rendering thread fills the current
+ * buffer and hands it to the writer thread when it is full or when the output
+ * is flushed. The writer thread sends all the buffers handed to it with a
+ * single system call.
+ */
+#define BUFFER_SIZE             (256 * 1024)
+#ifndef DISABLE_THREADS
+#define BUFFERS_NR              4
+#else
+#define BUFFERS_NR              1
+#endif /* DISABLE_THREADS */
+
+/*
+ * Variables internes
+ * Internal variables
+ */
+static unsigned char* _buffers[BUFFERS_NR];
+static unsigned long _sizes[BUFFERS_NR];
+static unsigned long _current = 0;
+static volatile bool _error = false;
+
+#ifndef DISABLE_THREADS
+// Writer thread variables
+static pthread_t _writerThread;
+static bool _stopWriterThread = false;
+static unsigned long _firstReady = 0;
+static unsigned long _readyNr = 0;
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _readyCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t _freeCond = PTHREAD_COND_INITIALIZER;
+#endif /* DISABLE_THREADS */
+
+
+
+/*
+ * Envoi des données
+ * Data sending
+ */
+static bool __writeBuffers(unsigned long first, unsigned long nr)
+{
+    struct iovec iov[BUFFERS_NR];
+    unsigned long count = 0, current = 0;
+
+    for (unsigned long i=0; i < nr; i++) {
+        unsigned long j = (first + i) % BUFFERS_NR;
+
+        if (!_sizes[j])
+            continue;
+        iov[count].iov_base = _buffers[j];
+        iov[count].iov_len = _sizes[j];
+        count++;
+    }
+
+    while (current < count) {
+        ssize_t res;
+
+        if ((res = writev(STDOUT_FILENO, iov + current, count - current)) < 0) {
+            if (errno == EINTR)
+                continue;
+            ERRORMSG(_("Error while sending data to the printer (%u)"), errno);
+            return false;
+        }
+
+        // Skip what has been written
+        while (res && current < count) {
+            if ((size_t)res >= iov[current].iov_len) {
+                res -= iov[current].iov_len;
+                current++;
+            } else {
+                iov[current].iov_base = (unsigned char *)iov[current].iov_base +
+                    res;
+                iov[current].iov_len -= res;
+                res = 0;
+            }
+        }
+    }
+
+    return true;
+}
+
+static void __sendBuffer()
+{
+#ifndef DISABLE_THREADS
+    pthread_mutex_lock(&_lock);
+    _readyNr++;
+    pthread_cond_signal(&_readyCond);
+    while (_readyNr == BUFFERS_NR)
+        pthread_cond_wait(&_freeCond, &_lock);
+    pthread_mutex_unlock(&_lock);
+    _current = (_current + 1) % BUFFERS_NR;
+#else
+    if (!_error && !__writeBuffers(_current, 1))
+        _error = true;
+#endif /* DISABLE_THREADS */
+    _sizes[_current] = 0;
+}
+
+#ifndef DISABLE_THREADS
+static void* _writerThreadMain(void *data)
+{
+    DEBUGMSG(_("Writer thread loaded and is waiting for data"));
+    while (true) {
+        unsigned long first, nr;
+
+        pthread_mutex_lock(&_lock);
+        while (!_readyNr && !_stopWriterThread)
+            pthread_cond_wait(&_readyCond, &_lock);
+        first = _firstReady;
+        nr = _readyNr;
+        pthread_mutex_unlock(&_lock);
+        if (!nr)
+            break;
+
+        // Once an error occurred, the data are dropped
+        if (!_error && !__writeBuffers(first, nr))
+            _error = true;
+
+        // Give the buffers back to the rendering thread
+        pthread_mutex_lock(&_lock);
+        _firstReady = (first + nr) % BUFFERS_NR;
+        _readyNr -= nr;
+        pthread_cond_signal(&_freeCond);
+        pthread_mutex_unlock(&_lock);
+    }
+
+    DEBUGMSG(_("Writer thread unloaded. See ya"));
+    return NULL;
+}
+#endif /* DISABLE_THREADS */
+
+bool writeOutput(const void* data, unsigned long size)
+{
+    const unsigned char *ptr = (const unsigned char *)data;
+
+    while (size) {
+        unsigned long len = BUFFER_SIZE - _sizes[_current];
+
+        if (!len) {
+            __sendBuffer();
+            continue;
+        }
+        if (len > size)
+            len = size;
+        memcpy(_buffers[_current] + _sizes[_current], ptr, len);
+        _sizes[_current] += len;
+        ptr += len;
+        size -= len;
+    }
+
+    return !_error;
+}
+
+bool printOutput(const char* format, ...)
+{
+    va_list ap;
+    int len;
+
+    va_start(ap, format);
+    len = vsnprintf(NULL, 0, format, ap);
+    va_end(ap);
+    if (len < 0)
+        return false;
+
+    // Strings bigger than a buffer are formatted apart
+    if (len >= BUFFER_SIZE) {
+        char *string = new char[len + 1];
+        bool res;
+
+        va_start(ap, format);
+        vsnprintf(string, len + 1, format, ap);
+        va_end(ap);
+        res = writeOutput(string, len);
+        delete[] string;
+        return res;
+    }
+
+    // vsnprintf needs room for the trailing null character
+    if (BUFFER_SIZE - _sizes[_current] <= (unsigned long)len)
+        __sendBuffer();
+    va_start(ap, format);
+    vsnprintf((char *)_buffers[_current] + _sizes[_current], len + 1, format,
+        ap);
+    va_end(ap);
+    _sizes[_current] += len;
+
+    return !_error;
+}
+
+bool flushOutput()
+{
+    if (_sizes[_current])
+        __sendBuffer();
+    return !_error;
+}
+
+
+
+/*
+ * Initialisation et clôture de la sortie
+ * Output initialization and uninitialization
+ */
+bool initializeOutput()
+{
+    for (unsigned long i=0; i < BUFFERS_NR; i++) {
+        _buffers[i] = new unsigned char[BUFFER_SIZE];
+        _sizes[i] = 0;
+    }
+
+#ifndef DISABLE_THREADS
+    // Load the writer thread
+    if (pthread_create(&_writerThread, NULL, _writerThreadMain, NULL)) {
+        ERRORMSG(_("Cannot load the writer thread. Operation aborted."));
+        return false;
+    }
+#endif /* DISABLE_THREADS */
+
+    return true;
+}
+
+bool uninitializeOutput()
+{
+    bool res = true;
+
+    flushOutput();
+
+#ifndef DISABLE_THREADS
+    // Stop the writer thread once all the buffers have been sent
+    pthread_mutex_lock(&_lock);
+    _stopWriterThread = true;
+    pthread_cond_signal(&_readyCond);
+    pthread_mutex_unlock(&_lock);
+    if (pthread_join(_writerThread, NULL)) {
+        ERRORMSG(_("An error occurred while waiting the end of the writer "
+            "thread"));
+        res = false;
+    }
+#endif /* DISABLE_THREADS */
+
+    for (unsigned long i=0; i < BUFFERS_NR; i++)
+        delete[] _buffers[i];
+
+    return res && !_error;
+}
+
+/* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
+
@@ -19,16 +19,11 @@
  * 
  */
 #include "page.h"
-#include <unistd.h>
 #include <string.h>
 #include "band.h"
+#include "spill.h"
 #include "errlog.h"
-
-/*
- * This magic formula reverse the bit of a byte. ie. the bit 1 becomes the 
- * bit 8, the bit 2 becomes the bit 7 etc.
- */
-#define REVERSE_BITS(N) ((N * 0x0202020202ULL & 0x010884422010ULL) % 1023)
+#include "planepool.h"
 
 /*
  * Constructeur - Destructeur
@@ -37,25 +32,37 @@
 Page::Page()
 {
     _empty = true;
+    _blank = false;
     _xResolution = 0;
     _yResolution = 0;
     _planes[0] = NULL;
     _planes[1] = NULL;
     _planes[2] = NULL;
     _planes[3] = NULL;
+    _inkLines = NULL;
     _firstBand = NULL;
     _lastBand = NULL;
     _bandsNr = 0;
     _bih = NULL;
+    _complete = true;
+#ifndef DISABLE_THREADS
+    pthread_mutex_init(&_bandsLock, NULL);
+    pthread_cond_init(&_bandsCond, NULL);
+#endif /* DISABLE_THREADS */
 }
 
 Page::~Page()
 {
     flushPlanes();
-    if (_firstBand)
-        delete _firstBand;
-    if (_bih)
-        delete[] _bih;
+#ifndef DISABLE_THREADS
+    // Bands may still be registered by the compression code
+    pthread_mutex_lock(&_bandsLock);
+    while (!_complete)
+        pthread_cond_wait(&_bandsCond, &_bandsLock);
+    pthread_mutex_unlock(&_bandsLock);
+    pthread_mutex_destroy(&_bandsLock);
+    pthread_cond_destroy(&_bandsCond);
+#endif /* DISABLE_THREADS */
 }
 
 
@@ -66,36 +73,49 @@ Page::~Page()
  */
 void Page::registerBand(Band *band)
 {
+    band->registerParent(this);
+#ifndef DISABLE_THREADS
+    pthread_mutex_lock(&_bandsLock);
+#endif /* DISABLE_THREADS */
     if (_lastBand)
         _lastBand->registerSibling(band);
     else
         _firstBand = band;
     _lastBand = band;
-    band->registerParent(this);
     _bandsNr++;
+#ifndef DISABLE_THREADS
+    if (!_complete)
+        pthread_cond_broadcast(&_bandsCond);
+    pthread_mutex_unlock(&_bandsLock);
+#endif /* DISABLE_THREADS */
 }
 
-
-
-/*
- * Rotation des couches
- * Rotate bitmaps planes
- */
-void Page::rotate()
+void Page::setComplete(bool complete)
 {
-    unsigned long size, midSize;
-    unsigned char tmp;
-
-    size  = _width * _height / 8;
-    midSize = size / 2;
+#ifndef DISABLE_THREADS
+    pthread_mutex_lock(&_bandsLock);
+    _complete = complete;
+    pthread_cond_broadcast(&_bandsCond);
+    pthread_mutex_unlock(&_bandsLock);
+#else
+    _complete = complete;
+#endif /* DISABLE_THREADS */
+}
 
-    for (unsigned int i=0; i < _colors; i++) {
-        for (unsigned long j=0; j < midSize; j++) {
-            tmp = _planes[i][j];
-            _planes[i][j] = REVERSE_BITS(_planes[i][size - j - 1]);
-            _planes[i][size - j - 1] = REVERSE_BITS(tmp);
-        }
-    }
+const Band* Page::nextBand(const Band* band)
+{
+    const Band *next;
+
+#ifndef DISABLE_THREADS
+    pthread_mutex_lock(&_bandsLock);
+    while (!(next = band ? band->sibling() : _firstBand) && !_complete)
+        pthread_cond_wait(&_bandsCond, &_bandsLock);
+    pthread_mutex_unlock(&_bandsLock);
+#else
+    next = band ? band->sibling() : _firstBand;
+#endif /* DISABLE_THREADS */
+
+    return next;
 }
 
 
@@ -108,20 +128,35 @@ void Page::flushPlanes()
 {
     for (unsigned int i=0; i < 4; i++) {
         if (_planes[i]) {
-            delete[] _planes[i];
+            releasePlane(_planes[i]);
             _planes[i] = NULL;
         }
     }
+    if (_inkLines) {
+        delete[] _inkLines;
+        _inkLines = NULL;
+    }
     _empty = false;
 }
 
 
 
+/*
+ * Mémoire utilisée par la page compressée
+ * Memory used by the compressed page
+ */
+unsigned long Page::memorySize() const
+{
+    return sizeof(Page) + _arena.size();
+}
+
+
+
 /*
  * Mise sur disque / Rechargement
  * Swapping / restoring
  */
-bool Page::swapToDisk(int fd)
+bool Page::swapToDisk(SpillWriter& writer)
 {
     unsigned long i;
     Band* band;
@@ -131,22 +166,22 @@ bool Page::swapToDisk(int fd)
             "representation"));
         return false;
     }
-    write(fd, &_xResolution, sizeof(_xResolution));
-    write(fd, &_yResolution, sizeof(_yResolution));
-    write(fd, &_width, sizeof(_width));
-    write(fd, &_height, sizeof(_height));
-    write(fd, &_colors, sizeof(_colors));
-    write(fd, &_pageNr, sizeof(_pageNr));
-    write(fd, &_copiesNr, sizeof(_copiesNr));
-    write(fd, &_compression, sizeof(_compression));
-    write(fd, &_empty, sizeof(_empty));
-    write(fd, &_bandsNr, sizeof(_bandsNr));
+    writer.copy(&_xResolution, sizeof(_xResolution));
+    writer.copy(&_yResolution, sizeof(_yResolution));
+    writer.copy(&_width, sizeof(_width));
+    writer.copy(&_height, sizeof(_height));
+    writer.copy(&_colors, sizeof(_colors));
+    writer.copy(&_pageNr, sizeof(_pageNr));
+    writer.copy(&_copiesNr, sizeof(_copiesNr));
+    writer.copy(&_compression, sizeof(_compression));
+    writer.copy(&_empty, sizeof(_empty));
+    writer.copy(&_bandsNr, sizeof(_bandsNr));
     /* Carefully check if there is BIH data and compression type is 0x15,
        before saving BIH data to file. */
     if (( 0x15 == _compression ) && ( _bandsNr > 0 ) && ( NULL != _bih ))
-        write(fd, _bih, 20);
+        writer.copy(_bih, 20);
     for (i=0, band = _firstBand; i < _bandsNr; i++) {
-        if (!band->swapToDisk(fd))
+        if (!band->swapToDisk(writer))
             return false;
         band = band->sibling();
     }
@@ -154,44 +189,40 @@ bool Page::swapToDisk(int fd)
     return true;
 }
 
-Page* Page::restoreIntoMemory(int fd)
+bool Page::restoreIntoMemory(SpillReader& reader)
 {
     unsigned long nr;
-    Page* page;
-
-    page = new Page();
-    read(fd, &page->_xResolution, sizeof(page->_xResolution));
-    read(fd, &page->_yResolution, sizeof(page->_yResolution));
-    read(fd, &page->_width, sizeof(page->_width));
-    read(fd, &page->_height, sizeof(page->_height));
-    read(fd, &page->_colors, sizeof(page->_colors));
-    read(fd, &page->_pageNr, sizeof(page->_pageNr));
-    read(fd, &page->_copiesNr, sizeof(page->_copiesNr));
-    read(fd, &page->_compression, sizeof(page->_compression));
-    read(fd, &page->_empty, sizeof(page->_empty));
-    read(fd, &nr, sizeof(nr));
+
+    if (!reader.read(&_xResolution, sizeof(_xResolution)) ||
+        !reader.read(&_yResolution, sizeof(_yResolution)) ||
+        !reader.read(&_width, sizeof(_width)) ||
+        !reader.read(&_height, sizeof(_height)) ||
+        !reader.read(&_colors, sizeof(_colors)) ||
+        !reader.read(&_pageNr, sizeof(_pageNr)) ||
+        !reader.read(&_copiesNr, sizeof(_copiesNr)) ||
+        !reader.read(&_compression, sizeof(_compression)) ||
+        !reader.read(&_empty, sizeof(_empty)) ||
+        !reader.read(&nr, sizeof(nr)))
+        return false;
     /* Check if compression type is 0x15 and that there is at least one
        image band before reading BIH data. */
-    if (( 0x15 == page->_compression ) && ( nr > 0 )) {
-        unsigned char bih[20];
-        read(fd, bih, 20);
-        page->setBIH(bih);
+    if (( 0x15 == _compression ) && ( nr > 0 )) {
+        if (!(_bih = (unsigned char *)reader.map(20)))
+            return false;
     }
     for (unsigned int i=0; i < nr; i++) {
-        Band *band = Band::restoreIntoMemory(fd);
-        if (!band) {
-            delete page;
-            return NULL;
-        }
-        page->registerBand(band);
+        Band *band = Band::restoreIntoMemory(reader, _arena);
+        if (!band)
+            return false;
+        registerBand(band);
     }
 
-    return page;
+    return true;
 }
 
 void Page::setBIH(const unsigned char *bih_data) {
     if (NULL == _bih)
-        _bih = new unsigned char[20];
+        _bih = (unsigned char *)_arena.allocate(20);
     memcpy(_bih, bih_data, 20);
 }
 
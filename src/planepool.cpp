@@ -0,0 +1,147 @@
+/*
+ * 	    planepool.cpp             (C) 2008, Aurélien Croc (AP²C)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the
+ *  Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ *  $Id$
+ * 
+ */
+#include "planepool.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+#ifndef DISABLE_THREADS
+#include "semaphore.h"
+#endif /* DISABLE_THREADS */
+
+/*
+ * Taille du pool, des pages larges et de l'entête d'un tampon
+ * Pool size, huge page size and buffer header size
+ */
+#define POOL_SIZE               4
+#define HUGE_PAGE_SIZE          (2 * 1024 * 1024)
+#define HEADER_SIZE             64
+
+/*
+ * Each buffer is allocated with its header in front of the data. The header
+ * keeps the size of the buffer and links the free buffers together. It is
+ * as large as a cache line to keep the data aligned for the kernels.
+ */
+typedef struct buffer_s {
+    unsigned long               size;
+    struct buffer_s*            next;
+} buffer_t;
+
+static buffer_t* _freeBuffers = NULL;
+static unsigned long _freeBuffersNr = 0;
+#ifndef DISABLE_THREADS
+static Semaphore _poolLock;
+#endif /* DISABLE_THREADS */
+
+
+
+/*
+ * Allocation
+ * Allocation
+ */
+static buffer_t* _newBuffer(unsigned long size)
+{
+    bool huge = size >= HUGE_PAGE_SIZE;
+    void *ptr;
+
+    if (posix_memalign(&ptr, huge ? HUGE_PAGE_SIZE : HEADER_SIZE, 
+        HEADER_SIZE + size))
+        return NULL;
+#ifdef MADV_HUGEPAGE
+    // The buffer is touched soon after, so ask for huge pages before
+    if (huge)
+        madvise(ptr, HEADER_SIZE + size, MADV_HUGEPAGE);
+#endif /* MADV_HUGEPAGE */
+    ((buffer_t *)ptr)->size = size;
+    ((buffer_t *)ptr)->next = NULL;
+
+    return (buffer_t *)ptr;
+}
+
+unsigned char* allocatePlane(unsigned long size)
+{
+    buffer_t *buffer, **prev;
+
+#ifndef DISABLE_THREADS
+    _poolLock.lock();
+#endif /* DISABLE_THREADS */
+    for (prev = &_freeBuffers; *prev && (*prev)->size != size; 
+        prev = &(*prev)->next);
+    buffer = *prev;
+    if (buffer) {
+        *prev = buffer->next;
+        _freeBuffersNr--;
+    }
+#ifndef DISABLE_THREADS
+    _poolLock.unlock();
+#endif /* DISABLE_THREADS */
+
+    if (!buffer && !(buffer = _newBuffer(size)))
+        return NULL;
+    return (unsigned char *)buffer + HEADER_SIZE;
+}
+
+
+
+/*
+ * Libération
+ * Release
+ */
+void releasePlane(unsigned char* plane)
+{
+    buffer_t *buffer, *oldest=NULL;
+
+    if (!plane)
+        return;
+    buffer = (buffer_t *)(plane - HEADER_SIZE);
+
+    // Keep the newest buffers, which match the geometry of the next pages
+#ifndef DISABLE_THREADS
+    _poolLock.lock();
+#endif /* DISABLE_THREADS */
+    buffer->next = _freeBuffers;
+    _freeBuffers = buffer;
+    if (++_freeBuffersNr > POOL_SIZE) {
+        for (buffer = _freeBuffers; buffer->next->next; 
+            buffer = buffer->next);
+        oldest = buffer->next;
+        buffer->next = NULL;
+        _freeBuffersNr--;
+    }
+#ifndef DISABLE_THREADS
+    _poolLock.unlock();
+#endif /* DISABLE_THREADS */
+
+    if (oldest)
+        free(oldest);
+}
+
+void releasePlanePool()
+{
+    while (_freeBuffers) {
+        buffer_t *next = _freeBuffers->next;
+
+        free(_freeBuffers);
+        _freeBuffers = next;
+    }
+    _freeBuffersNr = 0;
+}
+
+/* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
+
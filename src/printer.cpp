@@ -22,6 +22,7 @@
 #include <time.h>
 #include <string.h>
 #include "errlog.h"
+#include "output.h"
 #include "request.h"
 #include "ppdfile.h"
 
@@ -191,120 +192,119 @@ bool Printer::sendPJLHeader(const Request& request,
     time(&timestamp);
     timeinfo = localtime(&timestamp);
 
-    printf("%s", _beginPJL);
+    printOutput("%s", _beginPJL);
 
     if (0x15 == compression) {
-        printf("@PJL COMMENT USERNAME=\"Username: %s\"\n", request.userName());
-        printf("@PJL COMMENT DOCNAME=\"%s\"\n", request.jobTitle());
-        printf("@PJL JOB NAME=\"%s\"\n", request.jobTitle());
+        printOutput("@PJL COMMENT USERNAME=\"Username: %s\"\n", 
+            request.userName());
+        printOutput("@PJL COMMENT DOCNAME=\"%s\"\n", request.jobTitle());
+        printOutput("@PJL JOB NAME=\"%s\"\n", request.jobTitle());
     }
 
     // Information about the job
-    printf("@PJL DEFAULT SERVICEDATE=%04u%02u%02u\n", 1900+timeinfo->tm_year,
-        timeinfo->tm_mon+1, timeinfo->tm_mday);
-    printf("@PJL SET USERNAME=\"%s\"\n", request.userName());
-    printf("@PJL SET JOBNAME=\"%s\"\n", request.jobTitle());
+    printOutput("@PJL DEFAULT SERVICEDATE=%04u%02u%02u\n", 
+        1900+timeinfo->tm_year, timeinfo->tm_mon+1, timeinfo->tm_mday);
+    printOutput("@PJL SET USERNAME=\"%s\"\n", request.userName());
+    printOutput("@PJL SET JOBNAME=\"%s\"\n", request.jobTitle());
 
     if (0x15 == compression)
-        printf("@PJL SET MULTIBINMODE=%s\n", "PRINTERDEFAULT");
+        printOutput("@PJL SET MULTIBINMODE=%s\n", "PRINTERDEFAULT");
 
    // Set some printer options
     if (!request.ppd()->get("EconoMode").isNull() && 
         request.ppd()->get("EconoMode") != "0")
-        printf("@PJL SET ECONOMODE=%s\n", (const char *)request.ppd()->
+        printOutput("@PJL SET ECONOMODE=%s\n", (const char *)request.ppd()->
                 get("EconoMode"));
     if (!request.ppd()->get("PowerSave").isNull()) {
         if (request.ppd()->get("PowerSave") != "False") {
-            printf("@PJL DEFAULT POWERSAVE=ON\n");
-            printf("@PJL DEFAULT POWERSAVETIME=%s\n",
+            printOutput("@PJL DEFAULT POWERSAVE=ON\n");
+            printOutput("@PJL DEFAULT POWERSAVETIME=%s\n",
                 (const char *)request.ppd()->get("PowerSave"));
         } else
-            printf("@PJL DEFAULT POWERSAVE=OFF\n");
+            printOutput("@PJL DEFAULT POWERSAVE=OFF\n");
     }
 
     if (request.ppd()->get("JamRecovery").isTrue())
-        printf("@PJL SET JAMRECOVERY=ON\n");
+        printOutput("@PJL SET JAMRECOVERY=ON\n");
     else
-        printf("@PJL SET JAMRECOVERY=OFF\n");
+        printOutput("@PJL SET JAMRECOVERY=OFF\n");
     if (request.printer()->color()) {
         if (!strcasecmp(request.ppd()->get("ColorModel"), "CMYK"))
-            printf("@PJL SET COLORMODE=COLOR\n");
+            printOutput("@PJL SET COLORMODE=COLOR\n");
         else
-            printf("@PJL SET COLORMODE=MONO\n");
+            printOutput("@PJL SET COLORMODE=MONO\n");
     }
 
     if (0x15 == compression) {
-        printf("@PJL SET RESOLUTION=%lu\n", yResolution);
+        printOutput("@PJL SET RESOLUTION=%lu\n", yResolution);
         if ((600 == xResolution) && (600 == yResolution))
-            printf("@PJL SET IMAGEQUALITY=0\n");
+            printOutput("@PJL SET IMAGEQUALITY=0\n");
         if ((1200 == xResolution) && (600 == yResolution))
-            printf("@PJL SET IMAGEQUALITY=1\n");
-        printf("@PJL SET RGBCOLOR=%s\n", "STANDARD");
+            printOutput("@PJL SET IMAGEQUALITY=1\n");
+        printOutput("@PJL SET RGBCOLOR=%s\n", "STANDARD");
     }
 
     // Information about the duplex
     reverse = request.reverseDuplex() ? "REVERSE_" : "";
     switch (request.duplex()) {
         case Request::Simplex:
-            printf("@PJL SET DUPLEX=OFF\n");
+            printOutput("@PJL SET DUPLEX=OFF\n");
             break;
         case Request::LongEdge:
-            printf("@PJL SET DUPLEX=ON\n");
-            printf("@PJL SET BINDING=%sLONGEDGE\n", reverse);
+            printOutput("@PJL SET DUPLEX=ON\n");
+            printOutput("@PJL SET BINDING=%sLONGEDGE\n", reverse);
             break;
         case Request::ShortEdge:
-            printf("@PJL SET DUPLEX=ON\n");
-            printf("@PJL SET BINDING=%sSHORTEDGE\n", reverse);
+            printOutput("@PJL SET DUPLEX=ON\n");
+            printOutput("@PJL SET BINDING=%sSHORTEDGE\n", reverse);
             break;
         case Request::ManualLongEdge:
-            printf("@PJL SET DUPLEX=MANUAL\n");
-            printf("@PJL SET BINDING=LONGEDGE\n");
+            printOutput("@PJL SET DUPLEX=MANUAL\n");
+            printOutput("@PJL SET BINDING=LONGEDGE\n");
             break;
         case Request::ManualShortEdge:
-            printf("@PJL SET DUPLEX=MANUAL\n");
-            printf("@PJL SET BINDING=SHORTEDGE\n");
+            printOutput("@PJL SET DUPLEX=MANUAL\n");
+            printOutput("@PJL SET BINDING=SHORTEDGE\n");
             break;
     }
  
     // Set some job options
     if (request.ppd()->get("MediaType").isNull())
-        printf("@PJL SET PAPERTYPE=OFF\n");
+        printOutput("@PJL SET PAPERTYPE=OFF\n");
     else
-        printf("@PJL SET PAPERTYPE=%s\n", (const char *)request.ppd()->
+        printOutput("@PJL SET PAPERTYPE=%s\n", (const char *)request.ppd()->
                 get("MediaType"));
     if (request.ppd()->get("Altitude").isNull())
-        printf("@PJL SET ALTITUDE=LOW\n");
+        printOutput("@PJL SET ALTITUDE=LOW\n");
     else
-        printf("@PJL SET ALTITUDE=%s\n", (const char *)request.ppd()->
+        printOutput("@PJL SET ALTITUDE=%s\n", (const char *)request.ppd()->
                 get("Altitude"));
     if (request.ppd()->get("TonerDensity").isNull())
-        printf("@PJL SET DENSITY=3\n");
+        printOutput("@PJL SET DENSITY=3\n");
     else
-        printf("@PJL SET DENSITY=%s\n", (const char *)request.ppd()->
+        printOutput("@PJL SET DENSITY=%s\n", (const char *)request.ppd()->
                 get("TonerDensity"));
     if (request.ppd()->get("SRTMode").isNull())
-        printf("@PJL SET RET=NORMAL\n");
+        printOutput("@PJL SET RET=NORMAL\n");
     else
-        printf("@PJL SET RET=%s\n", (const char *)request.ppd()->
+        printOutput("@PJL SET RET=%s\n", (const char *)request.ppd()->
                 get("SRTMode"));
 
     if (0x15 == compression) {
-        printf("@PJL SET BANNERSHEET=%s\n", "OFF");
-        printf("@PJL SET TIMESTAMP=%s\n", "OFF");
+        printOutput("@PJL SET BANNERSHEET=%s\n", "OFF");
+        printOutput("@PJL SET TIMESTAMP=%s\n", "OFF");
     }
 
-    printf("@PJL ENTER LANGUAGE = QPDL\n");
-    fflush(stdout);
+    printOutput("@PJL ENTER LANGUAGE = QPDL\n");
 
-    return true;
+    return flushOutput();
 }
 
 bool Printer::sendPJLFooter(const Request& request) const
 {
-    printf("%s", _endPJL);
-    fflush(stdout);
+    printOutput("%s", _endPJL);
 
-    return true;
+    return flushOutput();
 }
 
 /* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
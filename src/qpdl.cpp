@@ -20,13 +20,13 @@
  */
 #include "qpdl.h"
 #include <errno.h>
-#include <unistd.h>
 #include <inttypes.h>
 #include <string.h>
 #include <math.h>
 #include "page.h"
 #include "band.h"
 #include "errlog.h"
+#include "output.h"
 #include "request.h"
 #include "bandplane.h"
 
@@ -40,26 +40,20 @@ static bool _outputAuxRecords(const Page* page)
     if (!band)
         return true;
     // Output record type 0x13 and marker for record 0x14 .
-    if (write(STDOUT_FILENO, (unsigned char*)&header, 16) == -1) {
-        ERRORMSG(_("Error while sending data to the printer (%u)"), errno);
+    if (!writeOutput((unsigned char*)&header, 16))
         return false;
-    }
     // Output BIH of JBIG data.
     if (page->getBIH()) {
-        if (write(STDOUT_FILENO, page->getBIH(), 20) == -1) {
-            ERRORMSG(_("Error while sending data to the printer (%u)"), errno);
+        if (!writeOutput(page->getBIH(), 20))
             return false;
-        }
     } else {
         ERRORMSG(_("Error getting BIH data for page (%u)"), errno);
         return false;
     }
     header[0] = 0; header[1] = 0; header[2] = 1;
     header[3] = (band->width() >> 8) + 65;
-    if (write(STDOUT_FILENO, (unsigned char*)&header, 4) == -1) {
-        ERRORMSG(_("Error while sending data to the printer (%u)"), errno);
+    if (!writeOutput((unsigned char*)&header, 4))
         return false;
-    }
     return true;
 }
 
@@ -105,25 +99,19 @@ static bool _renderJBIGBand(const Request& request, const Band* band, bool mono)
         header[0x9] = dataSize >> 16;            // Data size 16 - 23
         header[0xa] = dataSize >> 8;             // Data size 8 - 15
         header[0xb] = dataSize;                  // Data size 0 - 7
-        if (write(STDOUT_FILENO, (unsigned char*)&header, 0xc) == -1) {
-            ERRORMSG(_("Error while sending data (%u)"), errno);
+        if (!writeOutput((unsigned char*)&header, 0xc))
             return false;
-        }
         // Send the data
-        if (write(STDOUT_FILENO, plane->data(), plane->dataSize()) == -1) {
-            ERRORMSG(_("Error while sending data (%u)"), errno);
+        if (!writeOutput(plane->data(), plane->dataSize()))
             return false;
-        }
         // Calculate and send the checksum
         checkSum  = plane->checksum();
         header[0] = checkSum >> 24;              // Checksum 24 - 31
         header[1] = checkSum >> 16;              // Checksum 16 - 23
         header[2] = checkSum >> 8;               // Checksum 8 - 15
         header[3] = checkSum;                    // Checksum 0 - 7
-        if (write(STDOUT_FILENO, (unsigned char*)&header, 4) == -1) {
-            ERRORMSG(_("Error while sending data (%u)"), errno);
+        if (!writeOutput((unsigned char*)&header, 4))
             return false;
-        }
     }
     return true;
 }
@@ -202,10 +190,8 @@ static bool _renderBand(const Request& request, const Band* band, bool mono)
         header[size+2] = dataSize >> 16;            // Data size 16 - 23
         header[size+3] = dataSize >> 8;             // Data size 8 - 15
         header[size+4] = dataSize;                  // Data size 0 - 7
-        if (write(STDOUT_FILENO, (unsigned char*)&header, size+5) == -1) {
-            ERRORMSG(_("Error while sending data to the printer (%u)"), errno);
+        if (!writeOutput((unsigned char*)&header, size+5))
             return false;
-        }
 
         // Send the sub-header
         if (compression != 0x0D && compression != 0x0E) {
@@ -294,18 +280,13 @@ static bool _renderBand(const Request& request, const Band* band, bool mono)
             } else
                 for (unsigned int j=0; j < 4; j++)
                     checkSum += header[size - j - 1];
-            if (write(STDOUT_FILENO, (unsigned char*)&header, size) == -1) {
-                ERRORMSG(_("Error while sending data to the printer (%u)"),
-                    errno);
+            if (!writeOutput((unsigned char*)&header, size))
                 return false;
-            }
         }
         
         // Send the data
-        if (write(STDOUT_FILENO, plane->data(), plane->dataSize()) == -1) {
-            ERRORMSG(_("Error while sending data to the printer (%u)"), errno);
+        if (!writeOutput(plane->data(), plane->dataSize()))
             return false;
-        }
 
         // Send the checksum
         header[0] = checkSum >> 24;                 // Checksum 24 - 31
@@ -319,10 +300,8 @@ static bool _renderBand(const Request& request, const Band* band, bool mono)
             header[4] = 0;
             size++;
         }
-        if (write(STDOUT_FILENO, (unsigned char*)&header, size) == -1) {
-            ERRORMSG(_("Error while sending data to the printer (%u)"), errno);
+        if (!writeOutput((unsigned char*)&header, size))
             return false;
-        }
     }
 
     return true;
@@ -401,34 +380,31 @@ bool renderPage(const Request& request, Page* page, bool lastPage)
     header[0xe] = request.printer()->qpdlVersion(); // QPDL Version
     header[0xf] = request.printer()->unknownByte3();// ??? XXX
     header[0x10] = page->xResolution() / 100;       // X Resolution
-    if (write(STDOUT_FILENO, (unsigned char*)&header, 0x11) == -1) {
-        ERRORMSG(_("Error while sending data to the printer (%u)"), errno);
+    if (!writeOutput((unsigned char*)&header, 0x11))
         return false;
-    }
 
     // Send auxiliary records for clp-315 printers.
     if (0x15 == page->compression())
         if (!_outputAuxRecords(page))
             return false;
 
-    // Send the page bands
-    band = page->firstBand();
+    // Send the page bands as soon as they are available
+    band = page->nextBand(NULL);
     while (band) {
         if (!selectedRenderBand(request, band, page->colorsNr() == 1))
             return false;
-        band = band->sibling();
+        band = page->nextBand(band);
     }
 
     // Send the page footer
     header[0x0] = 1;                                // Signature
     header[0x1] = page->copiesNr() >> 8;            // Number of copies 8-15
     header[0x2] = page->copiesNr();                 // Number of copies 0-7
-    if (write(STDOUT_FILENO, (unsigned char*)&header, 0x3) == -1) {
-        ERRORMSG(_("Error while sending data to the printer (%u)"), errno);
+    if (!writeOutput((unsigned char*)&header, 0x3))
         return false;
-    }
 
-    return true;
+    // Let the writer thread send the whole page
+    return flushOutput();
 }
 
 /* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
@@ -24,6 +24,8 @@
 #include <cups/cups.h>
 #include "cache.h"
 #include "errlog.h"
+#include "kernels.h"
+#include "output.h"
 #include "version.h"
 #include "request.h"
 #include "ppdfile.h"
@@ -56,11 +58,14 @@ int main(int argc, char **argv)
     // Get more information on the SpliX environment (for debugging)
     DEBUGMSG(_("SpliX filter V. %s by Aurélien Croc (AP²C)"), VERSION);
     DEBUGMSG(_("More information at: http://splix.ap2c.org"));
-    DEBUGMSG(_("Compiled with: Threads=%s (#=%u, Cache=%u), JBIG=%s, "
+    DEBUGMSG(_("Compiled with: Threads=%s (#=%u, Cache=%u MB), JBIG=%s, "
         "BlackOptim=%s"), opt_threads ? _("enabled") : _("disabled"), 
         THREADS, CACHESIZE, opt_jbig ? _("enabled") : _("disabled"), 
         opt_blackoptim ? _("enabled") : _("disabled"));
 
+    // Select the kernels suited to the CPU
+    initializeKernels();
+
     // Open the given file
     if (file && !freopen(file, "r", stdin)) {
         ERRORMSG(_("Cannot open file %s"), file);
@@ -75,9 +80,15 @@ int main(int argc, char **argv)
     if (!request.loadRequest(&ppd, jobid, user, title, copies))
         return 2;
 
+    // Load the output writer
+    if (!initializeOutput())
+        return 3;
+
 #ifndef DISABLE_THREADS
-    if (!initializeCache())
+    if (!initializeCache(request)) {
+        uninitializeOutput();
         return 3;
+    }
 #endif /* DISABLE_THREADS */
 
     // Render the request
@@ -87,14 +98,21 @@ int main(int argc, char **argv)
 #ifndef DISABLE_THREADS
         uninitializeCache();
 #endif /* DISABLE_THREADS */
+        uninitializeOutput();
         return 4;
     }
 
 #ifndef DISABLE_THREADS
-    if (!uninitializeCache())
+    if (!uninitializeCache()) {
+        uninitializeOutput();
         return 5;
+    }
 #endif /* DISABLE_THREADS */
 
+    // Wait until all the data have been sent to the printer
+    if (!uninitializeOutput())
+        return 6;
+
     return 0;
 }
 
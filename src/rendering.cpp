@@ -23,11 +23,12 @@
 #include "page.h"
 #include "cache.h"
 #include "errlog.h"
-#include "colors.h"
 #include "request.h"
 #include "printer.h"
 #include "compress.h"
 #include "document.h"
+#include "workerpool.h"
+#include "planepool.h"
 
 #ifndef DISABLE_THREADS
 #include <pthread.h>
@@ -37,62 +38,166 @@ static Document document;
 static Semaphore _lock;
 static bool _returnState=true;
 
+/*
+ * Nombre de tâches données au groupe de threads par une page, au minimum
+ * Minimum number of jobs given to the worker pool by a page
+ */
+#define PAGE_JOBS_NR            4
+
+// Compression threads variables
+static pthread_t* _threads = NULL;
+static unsigned long _threadsNr = 0;
+static unsigned long _maxThreadsNr = 0;
+
+// Bounded queue of the pages read but not compressed yet
+static Page** _rawPages = NULL;
+static unsigned long _rawPagesIn=0, _rawPagesOut=0;
+static Semaphore _rawPagesFree(0);
+static Semaphore _rawPagesReady(0);
+
+
+
+/*
+ * File des pages à compresser
+ * Queue of the pages to compress
+ */
+static void _queueRawPage(Page* page)
+{
+    // Only the reader thread queues pages
+    _rawPagesFree--;
+    _rawPages[_rawPagesIn] = page;
+    _rawPagesIn = (_rawPagesIn + 1) % _maxThreadsNr;
+    _rawPagesReady++;
+}
+
+static Page* _dequeueRawPage()
+{
+    Page *page;
+
+    _rawPagesReady--;
+    _lock.lock();
+    page = _rawPages[_rawPagesOut];
+    _rawPagesOut = (_rawPagesOut + 1) % _maxThreadsNr;
+    _lock.unlock();
+    _rawPagesFree++;
+
+    return page;
+}
+
+static void _registerCompressedPage(Page* page, bool compressed)
+{
+    if (compressed) {
+        DEBUGMSG(_("Page %lu has been compressed and is ready for "
+            "rendering"), page->pageNr());
+    } else {
+        ERRORMSG(_("Error while compressing the page. Check the previous "
+            "message. Trying to print the other pages."));
+        page->setEmpty();
+        _returnState = false;
+    }
+    registerPage(page);
+}
+
+
+
+/*
+ * Compression d'une page
+ * Page compression
+ */
+static void _compressRawPage(const Request& request, Page* page)
+{
+    // The page has been rotated and its colors optimized while it was read
+    _registerCompressedPage(page, compressPage(request, page));
+}
+
+
+
 /*
  * This function is executed by each compression thread
  * It compress each page, page by page and store them
  * into the cache
  */
-static void *_compressPage(void* data)
+static void *_compressPages(void* data)
 {
     const Request *request = (const Request *)data;
-    bool rotateEvenPages;
     Page* page;
 
-    rotateEvenPages = request->duplex() == Request::ManualLongEdge;
-    do {
-        // Load the page
-        {
-            _lock.lock();
-            page = document.getNextRawPage(*request);
-            _lock.unlock();
-        }
-        if (!page) {
-            setNumberOfPages(document.numberOfPages());
-            break;
-        }
+    while ((page = _dequeueRawPage()))
+        _compressRawPage(*request, page);
 
-        // Make rotation on even pages for ManualLongEdge duplex mode
-        if (rotateEvenPages && !(page->pageNr() % 2)) {
-            page->rotate();
-        }
+    DEBUGMSG(_("Compression thread: work done. See ya"));
 
-        // Apply some colors optimizations
-#ifndef DISABLE_BLACKOPTIM
-        applyBlackOptimization(page);
-#endif /* DISABLE_BLACKOPTIM */
+    return NULL;
+}
 
-        // Compress the page
-        if (compressPage(*request, page)) {
-            DEBUGMSG(_("Page %lu has been compressed and is ready for "
-                "rendering"), page->pageNr());
-        } else {
-            ERRORMSG(_("Error while compressing the page. Check the previous "
-                "message. Trying to print the other pages."));
-            page->setEmpty();
-            _returnState = false;
+/*
+ * This function is executed by the reader thread
+ * It reads the document page by page. Streamed pages are registered in the
+ * cache at once so that their bands can be rendered while they are read and
+ * compressed by the worker pool. The other ones are queued for the
+ * compression threads which are loaded on demand
+ */
+static void *_readPages(void* data)
+{
+    const Request *request = (const Request *)data;
+    Page* page;
+
+    while ((page = document.getNextRawPage(*request))) {
+        if (document.isStreaming()) {
+            prepareStreamedPage(*request, page);
+            page->setComplete(false);
+            registerPage(page);
+            if (!compressStreamedPage(*request, page, document)) {
+                ERRORMSG(_("Error while compressing the page. Check the "
+                    "previous message. The page may be incomplete."));
+                _returnState = false;
+            }
+            completePage(page);
+            continue;
         }
-        registerPage(page);
-    } while (page);
 
-    DEBUGMSG(_("Compression thread: work done. See ya"));
+        // Load one more compression thread for each page until the limit
+        if (_threadsNr < _maxThreadsNr) {
+            if (!pthread_create(&_threads[_threadsNr], NULL, _compressPages,
+                (void*)request))
+                _threadsNr++;
+            else
+                ERRORMSG(_("Cannot load a compression thread"));
+        }
+        if (_threadsNr)
+            _queueRawPage(page);
+        else
+            _compressRawPage(*request, page);
+    }
+    setNumberOfPages(document.numberOfPages());
+
+    // Stop the compression threads
+    for (unsigned int i=0; i < _threadsNr; i++)
+        _queueRawPage(NULL);
+
+    DEBUGMSG(_("Reader thread: work done. See ya"));
 
     return NULL;
 }
 
+/*
+ * Libération des ressources du rendu
+ * Release the rendering resources
+ */
+static void _releaseRenderer()
+{
+    uninitializeWorkerPool();
+    releaseEncoders();
+    releasePlanePool();
+    delete[] _threads;
+    delete[] _rawPages;
+}
+
 bool render(Request& request)
 {
     bool manualDuplex=false, checkLastPage=false, lastPage=false;
-    pthread_t threads[THREADS];
+    unsigned long cpusNr;
+    pthread_t reader;
     Page *page;
 
     // Load the document
@@ -102,12 +207,38 @@ bool render(Request& request)
         return false;
     }
 
-    // Load the compression threads
-    for (unsigned int i=0; i < THREADS; i++) {
-        if (pthread_create(&threads[i], NULL, _compressPage, (void*)&request)) {
-            ERRORMSG(_("Cannot load compression threads. Operation aborted."));
-            return false;
-        }
+    // Compute the number of CPUs the compression can use
+    cpusNr = request.tuningValue("Threads", "SPLIX_THREADS", THREADS);
+    if (!cpusNr)
+        cpusNr = availableCPUsNr();
+
+    /*
+     * Chaque thread de compression exécute les tâches de sa page pendant
+     * qu'il les attend : le groupe de threads n'a que les CPU restants.
+     * Each compression thread runs the jobs of its page while it waits for
+     * them: the worker pool only gets the remaining CPUs. One compression
+     * thread is loaded for each PAGE_JOBS_NR CPUs, as a page gives at least
+     * one job per color.
+     */
+    _maxThreadsNr = (cpusNr + PAGE_JOBS_NR - 1) / PAGE_JOBS_NR;
+    DEBUGMSG(_("Up to %lu compression threads and %lu worker threads will "
+        "be used"), _maxThreadsNr, cpusNr - _maxThreadsNr);
+    _threads = new pthread_t[_maxThreadsNr];
+    _rawPages = new Page*[_maxThreadsNr];
+    for (unsigned long i=0; i < _maxThreadsNr; i++)
+        _rawPagesFree++;
+
+    // Load the worker pool shared by the compression threads
+    if (!initializeWorkerPool(cpusNr - _maxThreadsNr)) {
+        _releaseRenderer();
+        return false;
+    }
+
+    // Load the reader thread
+    if (pthread_create(&reader, NULL, _readPages, (void*)&request)) {
+        ERRORMSG(_("Cannot load the reader thread. Operation aborted."));
+        _releaseRenderer();
+        return false;
     }
 
     // Prepare the manual duplex
@@ -151,17 +282,23 @@ bool render(Request& request)
         delete page;
         page = getNextPage();
     }
+    if (hasLostPages())
+        _returnState = false;
 
     // Send the PJL footer
     request.printer()->sendPJLFooter(request);
+    reportCompressionStatistics();
 
     // Wait for threads to be finished
-    for (unsigned int i=0; i < THREADS; i++) {
+    if (pthread_join(reader, NULL))
+        ERRORMSG(_("An error occurred while waiting the end of a thread"));
+    for (unsigned int i=0; i < _threadsNr; i++) {
         void *result;
 
-        if (pthread_join(threads[i], &result))
+        if (pthread_join(_threads[i], &result))
             ERRORMSG(_("An error occurred while waiting the end of a thread"));
     }
+    _releaseRenderer();
 
     return _returnState;
 }
@@ -193,10 +330,14 @@ bool render(Request& request)
 
     // Send each page
     while (page) {
-#ifndef DISABLE_BLACKOPTIM
-        applyBlackOptimization(page);
-#endif /* DISABLE_BLACKOPTIM */
-        if (compressPage(request, page)) {
+        bool compressed;
+
+        if (document.isStreaming()) {
+            prepareStreamedPage(request, page);
+            compressed = compressStreamedPage(request, page, document);
+        } else
+            compressed = compressPage(request, page);
+        if (compressed) {
             if (!renderPage(request, page))
                 ERRORMSG(_("Error while rendering the page. Check the previous "
                             "message. Trying to print the other pages."));
@@ -210,6 +351,9 @@ bool render(Request& request)
 
     // Send the PJL footer
     request.printer()->sendPJLFooter(request);
+    reportCompressionStatistics();
+    releaseEncoders();
+    releasePlanePool();
 
     return true;
 }
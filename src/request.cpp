@@ -19,6 +19,9 @@
  * 
  */
 #include "request.h"
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
 #include "errlog.h"
 #include "ppdfile.h"
 
@@ -78,5 +81,46 @@ bool Request::loadRequest(PPDFile* ppd, const char *jobname,
     return true;
 }
 
+
+
+/*
+ * Valeurs de réglage du filtre
+ * Filter tuning values
+ */
+static bool __readTuningValue(const char *str, unsigned long& value)
+{
+    char *end;
+
+    if (!isdigit(*str))
+        return false;
+    errno = 0;
+    value = strtoul(str, &end, 10);
+    return !*end && errno != ERANGE;
+}
+
+unsigned long Request::tuningValue(const char *name, const char *envName,
+    unsigned long defaultValue) const
+{
+    unsigned long res;
+    const char *env;
+    PPDValue value;
+
+    if ((env = getenv(envName)) && *env) {
+        if (__readTuningValue(env, res))
+            return res;
+        ERRORMSG(_("Invalid value \"%s\" for %s. Using %lu"), env, envName,
+            defaultValue);
+        return defaultValue;
+    }
+    value = _ppd->get(name, "QPDL");
+    if (!value.isNull()) {
+        if (__readTuningValue(value, res))
+            return res;
+        ERRORMSG(_("Invalid value \"%s\" for the %s PPD attribute. Using %lu"),
+            (const char *)value, name, defaultValue);
+    }
+    return defaultValue;
+}
+
 /* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
 
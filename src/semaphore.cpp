@@ -80,8 +80,7 @@ Semaphore& Semaphore::operator --(int)
 Semaphore& Semaphore::operator ++(int)
 {
     pthread_mutex_lock(&_lock);
-    if (!_counter)
-        pthread_cond_signal(&_cond);
+    pthread_cond_signal(&_cond);
     _counter++;
     pthread_mutex_unlock(&_lock);
 
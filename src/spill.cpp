@@ -0,0 +1,205 @@
+/*
+ * 	    spill.cpp                 (C) 2008, Aurélien Croc (AP²C)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the
+ *  Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ *  $Id$
+ * 
+ */
+#include "spill.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#define MAX_IOVECS              64
+
+/*
+ * Constructeur - Destructeur
+ * Init - Uninit
+ */
+SpillWriter::SpillWriter()
+{
+    _segments = NULL;
+    _segmentsNr = 0;
+    _maxSegmentsNr = 0;
+    _fields = NULL;
+    _fieldsSize = 0;
+    _maxFieldsSize = 0;
+    _size = 0;
+}
+
+SpillWriter::~SpillWriter()
+{
+    if (_segments)
+        delete[] _segments;
+    if (_fields)
+        delete[] _fields;
+}
+
+SpillReader::SpillReader(const unsigned char* data, unsigned long size)
+{
+    _data = data;
+    _size = size;
+    _position = 0;
+}
+
+SpillReader::~SpillReader()
+{
+}
+
+
+
+/*
+ * Construction de la représentation
+ * Build the representation
+ */
+void SpillWriter::_appendSegment(const unsigned char* data, 
+    unsigned long offset, unsigned long size)
+{
+    segment_t *last = _segmentsNr ? &_segments[_segmentsNr - 1] : NULL;
+
+    // Extend the last segment if the fields are contiguous
+    if (!data && last && !last->data && last->offset + last->size == offset) {
+        last->size += size;
+        return;
+    }
+
+    if (_segmentsNr == _maxSegmentsNr) {
+        segment_t *tmp;
+
+        _maxSegmentsNr = _maxSegmentsNr ? _maxSegmentsNr * 2 : 16;
+        tmp = new segment_t[_maxSegmentsNr];
+        if (_segments) {
+            memcpy(tmp, _segments, _segmentsNr * sizeof(segment_t));
+            delete[] _segments;
+        }
+        _segments = tmp;
+    }
+    _segments[_segmentsNr].data = data;
+    _segments[_segmentsNr].offset = offset;
+    _segments[_segmentsNr].size = size;
+    _segmentsNr++;
+}
+
+void SpillWriter::copy(const void* data, unsigned long size)
+{
+    if (!size)
+        return;
+    if (_fieldsSize + size > _maxFieldsSize) {
+        unsigned char *tmp;
+
+        _maxFieldsSize = _maxFieldsSize ? _maxFieldsSize * 2 : 256;
+        if (_maxFieldsSize < _fieldsSize + size)
+            _maxFieldsSize = _fieldsSize + size;
+        tmp = new unsigned char[_maxFieldsSize];
+        if (_fields) {
+            memcpy(tmp, _fields, _fieldsSize);
+            delete[] _fields;
+        }
+        _fields = tmp;
+    }
+    memcpy(_fields + _fieldsSize, data, size);
+    _appendSegment(NULL, _fieldsSize, size);
+    _fieldsSize += size;
+    _size += size;
+}
+
+void SpillWriter::reference(const void* data, unsigned long size)
+{
+    if (!size)
+        return;
+    _appendSegment((const unsigned char *)data, 0, size);
+    _size += size;
+}
+
+
+
+/*
+ * Écriture de la représentation
+ * Write the representation
+ */
+bool SpillWriter::writeAt(int fd, off_t offset) const
+{
+    struct iovec iov[MAX_IOVECS];
+    unsigned long current = 0, done = 0;
+
+    while (current < _segmentsNr) {
+        unsigned long nr = 0;
+        ssize_t res;
+
+        // Prepare the next segments
+        for (unsigned long i=current; i < _segmentsNr && nr < MAX_IOVECS; 
+            i++, nr++) {
+            const unsigned char *data = _segments[i].data ? _segments[i].data :
+                _fields + _segments[i].offset;
+            unsigned long skip = i == current ? done : 0;
+
+            iov[nr].iov_base = (void *)(data + skip);
+            iov[nr].iov_len = _segments[i].size - skip;
+        }
+
+        // Write them and skip what has been written
+        if ((res = pwritev(fd, iov, nr, offset)) < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        offset += res;
+        while (res && current < _segmentsNr) {
+            unsigned long left = _segments[current].size - done;
+
+            if ((unsigned long)res >= left) {
+                res -= left;
+                current++;
+                done = 0;
+            } else {
+                done += res;
+                res = 0;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+
+/*
+ * Lecture de la représentation
+ * Read the representation
+ */
+bool SpillReader::read(void* data, unsigned long size)
+{
+    if (size > _size - _position)
+        return false;
+    memcpy(data, _data + _position, size);
+    _position += size;
+
+    return true;
+}
+
+const unsigned char* SpillReader::map(unsigned long size)
+{
+    const unsigned char *data = _data + _position;
+
+    if (size > _size - _position)
+        return NULL;
+    _position += size;
+
+    return data;
+}
+
+/* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
+
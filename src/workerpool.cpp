@@ -0,0 +1,342 @@
+/*
+ * 	    workerpool.cpp            (C) 2008, Aurélien Croc (AP²C)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the
+ *  Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ *  $Id$
+ * 
+ */
+#include "workerpool.h"
+#include <stdio.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "errlog.h"
+
+/*
+ * Constructeur - Destructeur
+ * Init - Uninit
+ */
+Job::Job()
+{
+    _nextJob = NULL;
+    _group = NULL;
+}
+
+Job::~Job()
+{
+}
+
+
+
+/*
+ * Nombre de processeurs disponibles
+ * Number of available CPUs
+ */
+static unsigned long _readCgroupQuota()
+{
+    unsigned long quota = 0;
+    long long value, period;
+    char max[32];
+    FILE *file;
+
+    // Control group v2
+    if ((file = fopen("/sys/fs/cgroup/cpu.max", "r"))) {
+        if (fscanf(file, "%31s %lld", max, &period) == 2 && 
+            strcmp(max, "max") && period > 0 && 
+            (value = strtoll(max, (char **)NULL, 10)) > 0)
+            quota = (value + period - 1) / period;
+        fclose(file);
+        return quota;
+    }
+
+    // Control group v1
+    if ((file = fopen("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r"))) {
+        if (fscanf(file, "%lld", &value) != 1)
+            value = -1;
+        fclose(file);
+        if (value > 0 && (file = fopen("/sys/fs/cgroup/cpu/cpu.cfs_period_us",
+            "r"))) {
+            if (fscanf(file, "%lld", &period) == 1 && period > 0)
+                quota = (value + period - 1) / period;
+            fclose(file);
+        }
+    }
+
+    return quota;
+}
+
+unsigned long availableCPUsNr()
+{
+    unsigned long nr = 1, quota;
+    long online;
+#ifdef CPU_COUNT
+    cpu_set_t set;
+#endif /* CPU_COUNT */
+
+    if ((online = sysconf(_SC_NPROCESSORS_ONLN)) > 0)
+        nr = online;
+#ifdef CPU_COUNT
+    if (!sched_getaffinity(0, sizeof(set), &set) && CPU_COUNT(&set) > 0 &&
+        (unsigned long)CPU_COUNT(&set) < nr)
+        nr = CPU_COUNT(&set);
+#endif /* CPU_COUNT */
+    if ((quota = _readCgroupQuota()) && quota < nr)
+        nr = quota;
+
+    return nr;
+}
+
+
+
+#ifndef DISABLE_THREADS
+#include <pthread.h>
+
+/*
+ * Variables internes
+ * Internal variables
+ */
+// Worker threads variables
+static pthread_t *_threads = NULL;
+static unsigned long _threadsNr = 0;
+static unsigned long _maxThreadsNr = 0;
+static Semaphore _threadsLock;
+static bool _stopWorkers = false;
+
+// Job queue variables
+static Job *_queue = NULL, *_lastQueue = NULL;
+static Semaphore _queueLock;
+static Semaphore _jobsAvailable(0);
+
+
+
+/*
+ * Threads de travail
+ * Worker threads
+ */
+static void* _workerThread(void *data)
+{
+    while (true) {
+        _jobsAvailable--;
+        if (_stopWorkers)
+            break;
+
+        // The job may have already been executed by a waiting thread
+        JobGroup::runQueuedJob();
+    }
+
+    return NULL;
+}
+
+static void _loadWorkerThreads(unsigned long nr)
+{
+    // Load more worker threads if there are not enough for these jobs
+    _threadsLock.lock();
+    while (_threadsNr < nr && _threadsNr < _maxThreadsNr) {
+        if (pthread_create(&_threads[_threadsNr], NULL, _workerThread, NULL)) {
+            // The waiting threads will execute the jobs
+            ERRORMSG(_("Cannot load a worker thread"));
+            break;
+        }
+        _threadsNr++;
+        DEBUGMSG(_("Worker pool: %lu threads loaded"), _threadsNr);
+    }
+    _threadsLock.unlock();
+}
+
+
+
+/*
+ * Initialisation et clôture du groupe de threads
+ * Worker pool initialization and uninitialization
+ */
+bool initializeWorkerPool(unsigned long threadsNr)
+{
+    _stopWorkers = false;
+    _threads = new pthread_t[threadsNr];
+    _threadsNr = 0;
+    _maxThreadsNr = threadsNr;
+    DEBUGMSG(_("Worker pool can load up to %lu threads"), _maxThreadsNr);
+
+    return true;
+}
+
+bool uninitializeWorkerPool()
+{
+    bool res = true;
+
+    _stopWorkers = true;
+    for (unsigned long i=0; i < _threadsNr; i++)
+        _jobsAvailable++;
+    for (unsigned long i=0; i < _threadsNr; i++) {
+        void *result;
+
+        if (pthread_join(_threads[i], &result)) {
+            ERRORMSG(_("An error occurred while waiting the end of a worker "
+                "thread"));
+            res = false;
+        }
+    }
+    delete[] _threads;
+    _threads = NULL;
+    _threadsNr = 0;
+    _maxThreadsNr = 0;
+
+    return res;
+}
+
+
+
+/*
+ * Groupe de tâches
+ * Job group
+ */
+JobGroup::JobGroup() : _done(0)
+{
+    _queued = 0;
+}
+
+JobGroup::~JobGroup()
+{
+    wait();
+}
+
+void JobGroup::queue(Job** jobs, unsigned long nr)
+{
+    if (!nr)
+        return;
+    if (!_maxThreadsNr) {
+        for (unsigned long i=0; i < nr; i++)
+            jobs[i]->run();
+        return;
+    }
+    _loadWorkerThreads(nr);
+
+    // Chain the jobs and append them to the queue
+    for (unsigned long i=0; i < nr; i++) {
+        jobs[i]->_group = this;
+        jobs[i]->_nextJob = i + 1 < nr ? jobs[i + 1] : NULL;
+    }
+    {
+        _queueLock.lock();
+        if (_lastQueue)
+            _lastQueue->_nextJob = jobs[0];
+        else
+            _queue = jobs[0];
+        _lastQueue = jobs[nr - 1];
+        _queueLock.unlock();
+    }
+    _queued += nr;
+    for (unsigned long i=0; i < nr; i++)
+        _jobsAvailable++;
+}
+
+void JobGroup::wait()
+{
+    // Help the worker threads instead of sleeping
+    while (_queued && runQueuedJob());
+
+    // Wait for the end of the jobs executed by the other threads
+    for (; _queued; _queued--)
+        _done--;
+}
+
+bool JobGroup::runQueuedJob()
+{
+    Job *job;
+
+    _queueLock.lock();
+    job = _queue;
+    if (job) {
+        _queue = job->_nextJob;
+        if (!_queue)
+            _lastQueue = NULL;
+    }
+    _queueLock.unlock();
+    if (!job)
+        return false;
+
+    job->run();
+    job->_group->_done++;
+
+    return true;
+}
+
+#else /* DISABLE_THREADS */
+
+bool initializeWorkerPool(unsigned long threadsNr)
+{
+    return true;
+}
+
+bool uninitializeWorkerPool()
+{
+    return true;
+}
+
+
+
+/*
+ * Groupe de tâches
+ * Job group
+ */
+JobGroup::JobGroup()
+{
+    _queued = 0;
+}
+
+JobGroup::~JobGroup()
+{
+}
+
+void JobGroup::queue(Job** jobs, unsigned long nr)
+{
+    for (unsigned long i=0; i < nr; i++)
+        jobs[i]->run();
+}
+
+void JobGroup::wait()
+{
+}
+
+bool JobGroup::runQueuedJob()
+{
+    return false;
+}
+
+#endif /* DISABLE_THREADS */
+
+
+
+/*
+ * Exécution d'une liste de tâches
+ * Run a list of jobs
+ */
+void runJobs(Job** jobs, unsigned long nr)
+{
+    JobGroup group;
+
+    if (nr < 2) {
+        for (unsigned long i=0; i < nr; i++)
+            jobs[i]->run();
+        return;
+    }
+    group.queue(jobs, nr);
+    group.wait();
+}
+
+/* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
+
@@ -0,0 +1,289 @@
+/*
+ * 	    kernels.cpp               (C) 2008, Aurélien Croc (AP²C)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; version 2 of the License.
+ * 
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the
+ *  Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ *  $Id$
+ * 
+ */
+#include "kernels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Each implementation of the kernels is run on random buffers of random
+ * sizes and alignments. The results are compared with the ones of the
+ * portable implementation, which is itself checked against a bit by bit
+ * definition of the kernels. The implementations the CPU does not support
+ * are skipped.
+ */
+#define TESTS_NR                2000
+#define MAX_SIZE                1300
+#define MAX_OFFSET              64
+
+static const char* _levels[] = {"portable", "SSE2", "AVX2", "AVX-512"};
+#define LEVELS_NR               (sizeof(_levels) / sizeof(_levels[0]))
+
+typedef struct {
+    unsigned long               size;
+    unsigned char*              data;
+    unsigned char*              planes[4];
+    unsigned char               blank;
+    unsigned char*              blankData;
+} test_t;
+
+typedef struct {
+    bool                        isBlank;
+    unsigned char*              reversed;
+    unsigned char*              planes[4];
+} result_t;
+
+
+
+/*
+ * Définitions bit à bit
+ * Bit by bit definitions
+ */
+static unsigned char _reverseBits(unsigned char b)
+{
+    unsigned char r = 0;
+
+    for (unsigned int i=0; i < 8; i++)
+        if (b & (1 << i))
+            r |= 0x80 >> i;
+    return r;
+}
+
+static void _reverseDefinition(unsigned char* data, unsigned long size)
+{
+    unsigned char tmp;
+
+    for (unsigned long i=0; i < size / 2; i++) {
+        tmp = data[i];
+        data[i] = _reverseBits(data[size - i - 1]);
+        data[size - i - 1] = _reverseBits(tmp);
+    }
+    if (size % 2)
+        data[size / 2] = _reverseBits(data[size / 2]);
+}
+
+static void _optimizeBlackDefinition(unsigned char* planes[4], 
+    unsigned long size)
+{
+    unsigned char c, m, y, k;
+
+    for (unsigned long i=0; i < size; i++) {
+        for (unsigned int bit=0; bit < 8; bit++) {
+            c = planes[0][i] >> bit & 1;
+            m = planes[1][i] >> bit & 1;
+            y = planes[2][i] >> bit & 1;
+            k = planes[3][i] >> bit & 1;
+            if (k)
+                c = m = y = 0;
+            else if (c && m && y) {
+                c = m = y = 0;
+                k = 1;
+            }
+            planes[0][i] = (planes[0][i] & ~(1 << bit)) | c << bit;
+            planes[1][i] = (planes[1][i] & ~(1 << bit)) | m << bit;
+            planes[2][i] = (planes[2][i] & ~(1 << bit)) | y << bit;
+            planes[3][i] = (planes[3][i] & ~(1 << bit)) | k << bit;
+        }
+    }
+}
+
+static bool _isBlankDefinition(const unsigned char* data, unsigned long size,
+    unsigned char blank)
+{
+    for (unsigned long i=0; i < size; i++)
+        if (data[i] != blank)
+            return false;
+    return true;
+}
+
+
+
+/*
+ * Génération des tests
+ * Tests generation
+ */
+static unsigned char* _allocate(unsigned char** buffer)
+{
+    *buffer = new unsigned char[MAX_SIZE + MAX_OFFSET];
+    return *buffer + rand() % MAX_OFFSET;
+}
+
+static unsigned char _randomByte(unsigned int density)
+{
+    switch (density) {
+        case 0:
+            return 0;
+        case 1:
+            return rand() & rand() & rand();
+        case 2:
+            return rand();
+        default:
+            return rand() | rand();
+    }
+}
+
+static void _generate(test_t& test)
+{
+    unsigned int density = 0;
+
+    // Sizes around the vector sizes are more likely to show errors
+    test.size = rand() % 4 ? rand() % (MAX_SIZE + 1) : 
+        (rand() % 20 + 1) * 64 + rand() % 3 - 1;
+    if (test.size > MAX_SIZE)
+        test.size = MAX_SIZE;
+
+    for (unsigned long i=0; i < test.size; i++)
+        test.data[i] = rand();
+
+    // Colored areas and black areas are mixed in each plane
+    for (unsigned int j=0; j < 4; j++) {
+        for (unsigned long i=0; i < test.size; i++) {
+            if (!(i % 32))
+                density = rand() % 4;
+            test.planes[j][i] = _randomByte(density);
+        }
+    }
+
+    // A blank buffer with a dot somewhere, or not
+    test.blank = rand() % 2 ? 0xFF : 0x00;
+    memset(test.blankData, test.blank, test.size);
+    if (test.size && rand() % 2)
+        test.blankData[rand() % test.size] ^= 1 << rand() % 8;
+}
+
+static void _run(const test_t& test, result_t& result)
+{
+    memcpy(result.reversed, test.data, test.size);
+    reverseBuffer(result.reversed, test.size);
+    for (unsigned int j=0; j < 4; j++)
+        memcpy(result.planes[j], test.planes[j], test.size);
+    optimizeBlack(result.planes, test.size);
+    result.isBlank = isBlankBuffer(test.blankData, test.size, test.blank);
+}
+
+static void _runDefinition(const test_t& test, result_t& result)
+{
+    memcpy(result.reversed, test.data, test.size);
+    _reverseDefinition(result.reversed, test.size);
+    for (unsigned int j=0; j < 4; j++)
+        memcpy(result.planes[j], test.planes[j], test.size);
+    _optimizeBlackDefinition(result.planes, test.size);
+    result.isBlank = _isBlankDefinition(test.blankData, test.size, 
+        test.blank);
+}
+
+static bool _compare(const char* name, const test_t& test, 
+    const result_t& result, const result_t& expected)
+{
+    bool res = true;
+
+    if (memcmp(result.reversed, expected.reversed, test.size)) {
+        fprintf(stderr, "%s: reverseBuffer failed on %lu bytes\n", name, 
+            test.size);
+        res = false;
+    }
+    for (unsigned int j=0; j < 4; j++) {
+        if (memcmp(result.planes[j], expected.planes[j], test.size)) {
+            fprintf(stderr, "%s: optimizeBlack failed on %lu bytes\n", name,
+                test.size);
+            res = false;
+            break;
+        }
+    }
+    if (result.isBlank != expected.isBlank) {
+        fprintf(stderr, "%s: isBlankBuffer failed on %lu bytes\n", name,
+            test.size);
+        res = false;
+    }
+    return res;
+}
+
+
+
+/*
+ * Programme principal
+ * Main program
+ */
+int main()
+{
+    unsigned char *buffers[2 + 4 + 3 * 5];
+    unsigned long failed[LEVELS_NR];
+    bool supported[LEVELS_NR];
+    result_t expected, result, definition;
+    result_t *results[3] = {&expected, &result, &definition};
+    unsigned int nr = 0;
+    bool res = true;
+    test_t test;
+
+    srand(1);
+    test.data = _allocate(&buffers[nr++]);
+    test.blankData = _allocate(&buffers[nr++]);
+    for (unsigned int j=0; j < 4; j++)
+        test.planes[j] = _allocate(&buffers[nr++]);
+    for (unsigned int r=0; r < 3; r++) {
+        results[r]->reversed = _allocate(&buffers[nr++]);
+        for (unsigned int j=0; j < 4; j++)
+            results[r]->planes[j] = _allocate(&buffers[nr++]);
+    }
+    for (unsigned int i=0; i < LEVELS_NR; i++) {
+        supported[i] = selectKernels(_levels[i]);
+        failed[i] = 0;
+    }
+
+    for (unsigned int t=0; t < TESTS_NR; t++) {
+        _generate(test);
+
+        // The portable implementation gives the expected results
+        selectKernels("portable");
+        _run(test, expected);
+        _runDefinition(test, definition);
+        if (!_compare("portable", test, expected, definition))
+            failed[0]++;
+
+        for (unsigned int i=1; i < LEVELS_NR; i++) {
+            if (!supported[i])
+                continue;
+            selectKernels(_levels[i]);
+            _run(test, result);
+            if (!_compare(_levels[i], test, result, expected))
+                failed[i]++;
+        }
+    }
+
+    for (unsigned int i=0; i < LEVELS_NR; i++) {
+        if (!supported[i]) {
+            printf("%-10s skipped, not supported by the CPU\n", _levels[i]);
+            continue;
+        }
+        selectKernels(_levels[i]);
+        printf("%-10s %lu/%u tests passed\n", kernelsName(), 
+            TESTS_NR - failed[i], TESTS_NR);
+        if (failed[i])
+            res = false;
+    }
+
+    for (unsigned int i=0; i < nr; i++)
+        delete[] buffers[i];
+    return res ? 0 : 1;
+}
+
+/* vim: set expandtab tabstop=4 shiftwidth=4 smarttab tw=80 cin enc=utf8: */
+